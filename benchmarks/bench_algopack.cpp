@@ -0,0 +1,350 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <deque>
+#include <list>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "../main.cpp"
+
+// AlgoPack containers against their standard library counterparts. Every input comes from
+// a fixed seed, so runs are repeatable; to record results for comparison between versions:
+//
+//   bench_algopack --benchmark_out=results.json --benchmark_out_format=json
+//
+// or build the bench_algopack_json target, which does the same with repetitions. Sizes go
+// from 1K elements (cache-resident) to 4M (RAM-bound). Set benchmarks take a second
+// argument selecting the key distribution:
+//   0 random  distinct keys in shuffled order
+//   1 sorted  distinct keys in ascending order
+//   2 skewed  Zipf-like keys, heavy on duplicates of a few small values
+// Lookups and deletions use the keys in the order they were inserted.
+
+enum Distribution { random_keys, sorted_keys, skewed_keys };
+
+static std::vector<int> makeKeys(size_t n, int distribution)
+{
+  std::vector<int> keys(n);
+  std::mt19937 rng(42);
+  if (distribution == skewed_keys) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int & key : keys) key = static_cast<int>(n * std::pow(uniform(rng), 4.0));
+    return keys;
+  }
+  for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int>(2 * i);
+  if (distribution == random_keys) std::shuffle(keys.begin(), keys.end(), rng);
+  return keys;
+}
+
+static const char * distributionName(int distribution)
+{
+  static const char * names[] = {"random", "sorted", "skewed"};
+  return names[distribution];
+}
+
+// std::multiset stands in for BST, which also keeps duplicates
+template <typename Set>
+static void insertKey(Set & set, int key)
+{
+  set.insert(key);
+}
+
+template <typename Set>
+static bool containsKey(Set & set, int key)
+{
+  return set.search(key);
+}
+static bool containsKey(std::multiset<int> & set, int key) { return set.find(key) != set.end(); }
+
+template <typename Set>
+static void eraseKey(Set & set, int key)
+{
+  set.deleteNode(key);
+}
+static void eraseKey(std::multiset<int> & set, int key)
+{
+  auto it = set.find(key);
+  if (it != set.end()) set.erase(it);
+}
+
+template <typename Set>
+static void BM_SetInsert(benchmark::State & state)
+{
+  std::vector<int> keys = makeKeys(state.range(0), state.range(1));
+  for (auto _ : state) {
+    auto set = std::make_unique<Set>();
+    for (int key : keys) insertKey(*set, key);
+    benchmark::DoNotOptimize(set.get());
+    state.PauseTiming();
+    set.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.SetLabel(distributionName(state.range(1)));
+}
+
+template <typename Set>
+static void BM_SetSearch(benchmark::State & state)
+{
+  std::vector<int> keys = makeKeys(state.range(0), state.range(1));
+  Set set;
+  for (int key : keys) insertKey(set, key);
+  for (auto _ : state)
+    for (int key : keys) benchmark::DoNotOptimize(containsKey(set, key));
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.SetLabel(distributionName(state.range(1)));
+}
+
+template <typename Set>
+static void BM_SetErase(benchmark::State & state)
+{
+  std::vector<int> keys = makeKeys(state.range(0), state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto set = std::make_unique<Set>();
+    for (int key : keys) insertKey(*set, key);
+    state.ResumeTiming();
+    for (int key : keys) eraseKey(*set, key);
+    benchmark::DoNotOptimize(set.get());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.SetLabel(distributionName(state.range(1)));
+}
+
+template <typename Set>
+static void BM_SetIterate(benchmark::State & state)
+{
+  std::vector<int> keys = makeKeys(state.range(0), state.range(1));
+  Set set;
+  for (int key : keys) insertKey(set, key);
+  for (auto _ : state) {
+    long long sum = 0;
+    for (int v : set) sum += v;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.SetLabel(distributionName(state.range(1)));
+}
+
+static const std::vector<int64_t> sizes = {1 << 10, 1 << 14, 1 << 18, 1 << 22};
+
+static void SetArguments(benchmark::internal::Benchmark * b)
+{
+  b->ArgsProduct({sizes, {random_keys, sorted_keys, skewed_keys}});
+}
+
+// An unbalanced tree degenerates into a list on sorted or heavily duplicated keys, where
+// building it is quadratic; those cases stop at the second size
+static void UnbalancedSetArguments(benchmark::internal::Benchmark * b)
+{
+  for (int64_t size : sizes) b->Args({size, random_keys});
+  for (int distribution : {sorted_keys, skewed_keys})
+    for (int64_t size : {sizes[0], sizes[1]}) b->Args({size, distribution});
+}
+
+using CompactRBTree = CompactBST<int, std::less<int>, std::allocator<int>, true>;
+
+#define ALGOPACK_SET_BENCHMARKS(Set, Arguments)            \
+  BENCHMARK_TEMPLATE(BM_SetInsert, Set)->Apply(Arguments); \
+  BENCHMARK_TEMPLATE(BM_SetSearch, Set)->Apply(Arguments); \
+  BENCHMARK_TEMPLATE(BM_SetErase, Set)->Apply(Arguments);  \
+  BENCHMARK_TEMPLATE(BM_SetIterate, Set)->Apply(Arguments)
+
+ALGOPACK_SET_BENCHMARKS(BST<int>, UnbalancedSetArguments);
+ALGOPACK_SET_BENCHMARKS(RBTree<int>, SetArguments);
+ALGOPACK_SET_BENCHMARKS(BTree<int>, SetArguments);
+ALGOPACK_SET_BENCHMARKS(CompactRBTree, SetArguments);
+ALGOPACK_SET_BENCHMARKS(std::multiset<int>, SetArguments);
+
+// Lookups in a red-black CompactBST built from random keys, with the slots left in
+// insertion order (0), compacted in order (1) or in van Emde Boas order (2)
+static void BM_CompactBSTSearchByLayout(benchmark::State & state)
+{
+  std::vector<int> keys = makeKeys(state.range(0), random_keys);
+  CompactRBTree tree;
+  for (int key : keys) tree.insert(key);
+  if (state.range(1) == 1) tree.compact(CompactOrder::InOrder);
+  if (state.range(1) == 2) tree.compact(CompactOrder::VanEmdeBoas);
+  for (auto _ : state)
+    for (int key : keys) benchmark::DoNotOptimize(tree.search(key));
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  static const char * layouts[] = {"insertion", "in-order", "van Emde Boas"};
+  state.SetLabel(layouts[state.range(1)]);
+}
+BENCHMARK(BM_CompactBSTSearchByLayout)->ArgsProduct({sizes, {0, 1, 2}});
+
+// Lookups of std::string keys probed through std::string_view, as when the keys are slices
+// of a larger buffer. A tree ordered by std::less<std::string> needs a temporary string for
+// every probe; with the transparent std::less<> the view is compared directly. The keys are
+// longer than the small-string buffer, so each temporary allocates.
+template <typename Tree>
+static void BM_StringKeySearch(benchmark::State & state)
+{
+  std::vector<int> numbers = makeKeys(state.range(0), random_keys);
+  std::string text;
+  std::vector<std::pair<size_t, size_t>> slices;
+  Tree tree;
+  for (int number : numbers) {
+    std::string key = "algopack/key/" + std::to_string(number);
+    slices.emplace_back(text.size(), key.size());
+    text += key;
+    tree.insert(key);
+  }
+  for (auto _ : state) {
+    for (auto [offset, length] : slices) {
+      std::string_view key(text.data() + offset, length);
+      if constexpr (std::is_same_v<typename Tree::key_compare, std::less<>>)
+        benchmark::DoNotOptimize(tree.search(key));
+      else
+        benchmark::DoNotOptimize(tree.search(std::string(key)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * slices.size());
+}
+using TransparentStringTree = RBTree<std::string, std::less<>>;
+BENCHMARK_TEMPLATE(BM_StringKeySearch, RBTree<std::string>)->Arg(1 << 10)->Arg(1 << 18);
+BENCHMARK_TEMPLATE(BM_StringKeySearch, TransparentStringTree)->Arg(1 << 10)->Arg(1 << 18);
+
+template <typename List>
+static void BM_ListPushBack(benchmark::State & state)
+{
+  const int n = state.range(0);
+  for (auto _ : state) {
+    auto list = std::make_unique<List>();
+    for (int i = 0; i < n; ++i) list->push_back(i);
+    benchmark::DoNotOptimize(list.get());
+    state.PauseTiming();
+    list.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename List>
+static void BM_ListPushFront(benchmark::State & state)
+{
+  const int n = state.range(0);
+  for (auto _ : state) {
+    auto list = std::make_unique<List>();
+    for (int i = 0; i < n; ++i) list->push_front(i);
+    benchmark::DoNotOptimize(list.get());
+    state.PauseTiming();
+    list.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename List>
+static void BM_ListPopFront(benchmark::State & state)
+{
+  const int n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    List list;
+    for (int i = 0; i < n; ++i) list.push_back(i);
+    state.ResumeTiming();
+    for (int i = 0; i < n; ++i) list.pop_front();
+    benchmark::DoNotOptimize(list.empty());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename List>
+static void BM_ListIterate(benchmark::State & state)
+{
+  const int n = state.range(0);
+  List list;
+  for (int i = 0; i < n; ++i) list.push_back(i);
+  for (auto _ : state) {
+    long long sum = 0;
+    for (int v : list) sum += v;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Shuffled keys are written back into the same nodes before every sort, so only the
+// relinking is timed
+template <typename List>
+static void BM_ListSort(benchmark::State & state)
+{
+  const int n = state.range(0);
+  std::vector<int> keys = makeKeys(n, random_keys);
+  List list;
+  for (int key : keys) list.push_back(key);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto key = keys.begin();
+    for (int & v : list) v = *key++;
+    state.ResumeTiming();
+    list.sort();
+    benchmark::DoNotOptimize(&*list.begin());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Moves every second element to another list one node at a time, then splices that list
+// back in front as a whole; no element is allocated, copied or freed
+template <typename List>
+static void BM_ListSpliceAlternate(benchmark::State & state)
+{
+  const int n = state.range(0);
+  List list;
+  List odd;
+  for (int i = 0; i < n; ++i) list.push_back(i);
+  for (auto _ : state) {
+    for (auto it = list.begin(); it != list.end();) {
+      auto next = it;
+      if (++next == list.end()) break;
+      it = next;
+      ++it;
+      odd.splice(odd.end(), list, next);
+    }
+    list.splice(list.begin(), odd);
+    benchmark::DoNotOptimize(&*list.begin());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_LinkedListParallelSort(benchmark::State & state)
+{
+  const int n = state.range(0);
+  std::vector<int> keys = makeKeys(n, random_keys);
+  LinkedList<int> list;
+  for (int key : keys) list.push_back(key);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto key = keys.begin();
+    for (int & v : list) v = *key++;
+    state.ResumeTiming();
+    list.parallel_sort();
+    benchmark::DoNotOptimize(&*list.begin());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void ListArguments(benchmark::internal::Benchmark * b)
+{
+  for (int64_t size : sizes) b->Arg(size);
+}
+
+#define ALGOPACK_LIST_BENCHMARKS(List)                              \
+  BENCHMARK_TEMPLATE(BM_ListPushBack, List)->Apply(ListArguments);  \
+  BENCHMARK_TEMPLATE(BM_ListPushFront, List)->Apply(ListArguments); \
+  BENCHMARK_TEMPLATE(BM_ListPopFront, List)->Apply(ListArguments);  \
+  BENCHMARK_TEMPLATE(BM_ListIterate, List)->Apply(ListArguments)
+
+ALGOPACK_LIST_BENCHMARKS(LinkedList<int>);
+ALGOPACK_LIST_BENCHMARKS(UnrolledLinkedList<int>);
+ALGOPACK_LIST_BENCHMARKS(std::list<int>);
+ALGOPACK_LIST_BENCHMARKS(std::deque<int>);
+
+BENCHMARK_TEMPLATE(BM_ListSort, LinkedList<int>)->Apply(ListArguments);
+BENCHMARK_TEMPLATE(BM_ListSort, std::list<int>)->Apply(ListArguments);
+BENCHMARK(BM_LinkedListParallelSort)->Apply(ListArguments);
+BENCHMARK_TEMPLATE(BM_ListSpliceAlternate, LinkedList<int>)->Apply(ListArguments);
+BENCHMARK_TEMPLATE(BM_ListSpliceAlternate, std::list<int>)->Apply(ListArguments);
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <random>
+
+#include "../main.cpp"
+
+// Trees are built once per size with keys inserted in random order, so nodes on a search
+// path are scattered across the heap. Each benchmark iteration resolves a batch of keys,
+// half of which are present.
+
+static const size_t batch_size = 512;
+
+static RBTree<int> & treeOfSize(size_t n)
+{
+  static std::map<size_t, std::unique_ptr<RBTree<int>>> trees;
+  auto & tree = trees[n];
+  if (!tree) {
+    tree = std::make_unique<RBTree<int>>();
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int>(2 * i);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+    for (int key : keys) tree->insert(key);
+  }
+  return *tree;
+}
+
+static std::vector<int> queryKeys(size_t n)
+{
+  std::mt19937 rng(2);
+  std::vector<int> keys(batch_size);
+  for (int & key : keys) key = static_cast<int>(rng() % (2 * n));
+  return keys;
+}
+
+static void BM_SearchOneByOne(benchmark::State & state)
+{
+  RBTree<int> & tree = treeOfSize(state.range(0));
+  std::vector<int> keys = queryKeys(state.range(0));
+  std::vector<bool> results(keys.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < keys.size(); ++i) results[i] = tree.search(keys[i]);
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SearchOneByOne)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+static void BM_ContainsBatch(benchmark::State & state)
+{
+  RBTree<int> & tree = treeOfSize(state.range(0));
+  std::vector<int> keys = queryKeys(state.range(0));
+  std::vector<bool> results;
+  for (auto _ : state) {
+    tree.contains_batch(keys, results);
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_ContainsBatch)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
@@ -0,0 +1,49 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+#include "../main.cpp"
+
+// Merges a tree of n random keys into another of n random keys, either with the join-based
+// union_with or by inserting every key of one tree into the other.
+
+static std::vector<int> randomKeys(size_t n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int> keys(n);
+  for (int & key : keys) key = static_cast<int>(rng());
+  return keys;
+}
+
+static void BM_UnionWith(benchmark::State & state)
+{
+  std::vector<int> a = randomKeys(state.range(0), 1);
+  std::vector<int> b = randomKeys(state.range(0), 2);
+  for (auto _ : state) {
+    state.PauseTiming();
+    RBTree<int> left(a.begin(), a.end());
+    RBTree<int> right(b.begin(), b.end());
+    state.ResumeTiming();
+    left.union_with(std::move(right));
+    benchmark::DoNotOptimize(left.getSize());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_UnionWith)->RangeMultiplier(8)->Range(1 << 12, 1 << 21)->UseRealTime();
+
+static void BM_UnionByInsert(benchmark::State & state)
+{
+  std::vector<int> a = randomKeys(state.range(0), 1);
+  std::vector<int> b = randomKeys(state.range(0), 2);
+  for (auto _ : state) {
+    state.PauseTiming();
+    RBTree<int> left(a.begin(), a.end());
+    RBTree<int> right(b.begin(), b.end());
+    state.ResumeTiming();
+    for (auto it = right.cbegin(); it != right.cend(); ++it)
+      if (!left.search(*it)) left.insert(*it);
+    benchmark::DoNotOptimize(left.getSize());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_UnionByInsert)->RangeMultiplier(8)->Range(1 << 12, 1 << 21)->UseRealTime();
@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+
+#include "../main.cpp"
+
+// Every thread alternates push and pop on one shared queue, so throughput reflects how well
+// the queue handles contention rather than how fast it grows.
+
+static ConcurrentQueue<int> * lock_free_queue;
+
+static void SetupLockFree(const benchmark::State &) { lock_free_queue = new ConcurrentQueue<int>(); }
+static void TeardownLockFree(const benchmark::State &) { delete lock_free_queue; }
+
+static void BM_ConcurrentQueuePushPop(benchmark::State & state)
+{
+  int value = 0;
+  for (auto _ : state) {
+    lock_free_queue->push(value);
+    benchmark::DoNotOptimize(lock_free_queue->try_pop(value));
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_ConcurrentQueuePushPop)
+  ->Setup(SetupLockFree)
+  ->Teardown(TeardownLockFree)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
+
+struct LockedList
+{
+  std::mutex mutex;
+  LinkedList<int> list;
+};
+static LockedList * locked_list;
+
+static void SetupLocked(const benchmark::State &) { locked_list = new LockedList(); }
+static void TeardownLocked(const benchmark::State &) { delete locked_list; }
+
+static void BM_MutexLinkedListPushPop(benchmark::State & state)
+{
+  int value = 0;
+  for (auto _ : state) {
+    {
+      std::lock_guard<std::mutex> lock(locked_list->mutex);
+      locked_list->list.push_back(value);
+    }
+    {
+      std::lock_guard<std::mutex> lock(locked_list->mutex);
+      if (!locked_list->list.empty()) {
+        value = *locked_list->list.begin();
+        locked_list->list.pop_front();
+      }
+    }
+    benchmark::DoNotOptimize(value);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_MutexLinkedListPushPop)
+  ->Setup(SetupLocked)
+  ->Teardown(TeardownLocked)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <random>
+
+#include "../main.cpp"
+
+// Single-source shortest paths on a random graph with 8 out-edges per vertex and integer
+// weights in [1, 64], using each queue with lazy deletion (stale entries are skipped).
+
+static const unsigned max_weight = 64;
+
+using Graph = std::vector<std::vector<std::pair<unsigned, unsigned>>>;
+
+static const Graph & graphOfSize(unsigned n)
+{
+  static std::map<unsigned, Graph> graphs;
+  Graph & graph = graphs[n];
+  if (graph.empty()) {
+    std::mt19937 rng(5);
+    graph.resize(n);
+    for (unsigned u = 0; u < n; ++u)
+      for (int e = 0; e < 8; ++e) graph[u].push_back({rng() % n, 1 + rng() % max_weight});
+  }
+  return graph;
+}
+
+template <typename Queue>
+static void runDijkstra(benchmark::State & state, Queue & queue)
+{
+  const Graph & graph = graphOfSize(state.range(0));
+  std::vector<unsigned> dist(graph.size());
+  for (auto _ : state) {
+    std::fill(dist.begin(), dist.end(), std::numeric_limits<unsigned>::max());
+    dist[0] = 0;
+    queue.push(0u, 0u);
+    unsigned d, u;
+    while (!queue.empty()) {
+      queue.pop(d, u);
+      if (d != dist[u]) continue;
+      for (auto [v, w] : graph[u]) {
+        if (d + w < dist[v]) {
+          dist[v] = d + w;
+          queue.push(d + w, v);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(dist.data());
+  }
+  state.SetItemsProcessed(state.iterations() * graph.size());
+}
+
+struct HeapQueue
+{
+  PriorityQueue<std::pair<unsigned, unsigned>> heap;
+  bool empty() const { return heap.empty(); }
+  void push(unsigned d, unsigned u) { heap.push({d, u}); }
+  void pop(unsigned & d, unsigned & u)
+  {
+    std::pair<unsigned, unsigned> top;
+    heap.pop(top);
+    d = top.first;
+    u = top.second;
+  }
+};
+
+// The pattern the monotone queues replace: a tree used through getMinimum and deleteNode
+struct TreeQueue
+{
+  RBTree<std::pair<unsigned, unsigned>> tree;
+  bool empty() const { return tree.empty(); }
+  void push(unsigned d, unsigned u) { tree.insert({d, u}); }
+  void pop(unsigned & d, unsigned & u)
+  {
+    std::pair<unsigned, unsigned> top = tree.getMinimum();
+    tree.deleteNode(top);
+    d = top.first;
+    u = top.second;
+  }
+};
+
+static void BM_DijkstraBST(benchmark::State & state)
+{
+  TreeQueue queue;
+  runDijkstra(state, queue);
+}
+BENCHMARK(BM_DijkstraBST)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+static void BM_DijkstraPriorityQueue(benchmark::State & state)
+{
+  HeapQueue queue;
+  runDijkstra(state, queue);
+}
+BENCHMARK(BM_DijkstraPriorityQueue)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+static void BM_DijkstraRadixHeap(benchmark::State & state)
+{
+  RadixHeap<unsigned, unsigned> queue;
+  runDijkstra(state, queue);
+}
+BENCHMARK(BM_DijkstraRadixHeap)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+static void BM_DijkstraBucketQueue(benchmark::State & state)
+{
+  BucketQueue<unsigned, unsigned> queue(max_weight);
+  runDijkstra(state, queue);
+}
+BENCHMARK(BM_DijkstraBucketQueue)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
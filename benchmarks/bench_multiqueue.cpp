@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+#include <random>
+
+#include "../main.cpp"
+
+// Throughput: every thread alternates push and pop on one shared queue that starts with
+// prefill elements, so the queue neither drains nor grows. Quality: the mean rank error of
+// popped elements, i.e. how many smaller elements were still queued when one was popped.
+
+static const int prefill = 1 << 16;
+
+static MultiQueue<std::uint32_t> * multi_queue;
+
+static void SetupMulti(const benchmark::State & state)
+{
+  multi_queue = new MultiQueue<std::uint32_t>(state.threads());
+  std::mt19937 rng(1);
+  for (int i = 0; i < prefill; ++i) multi_queue->push(rng());
+}
+static void TeardownMulti(const benchmark::State &) { delete multi_queue; }
+
+static void BM_MultiQueuePushPop(benchmark::State & state)
+{
+  std::mt19937 rng(state.thread_index() + 2);
+  std::uint32_t value = 0;
+  for (auto _ : state) {
+    multi_queue->push(rng());
+    benchmark::DoNotOptimize(multi_queue->try_pop(value));
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_MultiQueuePushPop)
+  ->Setup(SetupMulti)
+  ->Teardown(TeardownMulti)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
+
+struct LockedHeap
+{
+  std::mutex mutex;
+  PriorityQueue<std::uint32_t> heap;
+};
+static LockedHeap * locked_heap;
+
+static void SetupLocked(const benchmark::State &)
+{
+  locked_heap = new LockedHeap();
+  std::mt19937 rng(1);
+  for (int i = 0; i < prefill; ++i) locked_heap->heap.push(rng());
+}
+static void TeardownLocked(const benchmark::State &) { delete locked_heap; }
+
+static void BM_LockedPriorityQueuePushPop(benchmark::State & state)
+{
+  std::mt19937 rng(state.thread_index() + 2);
+  std::uint32_t value = 0;
+  for (auto _ : state) {
+    std::lock_guard<std::mutex> lock(locked_heap->mutex);
+    locked_heap->heap.push(rng());
+    locked_heap->heap.pop(value);
+    benchmark::DoNotOptimize(value);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_LockedPriorityQueuePushPop)
+  ->Setup(SetupLocked)
+  ->Teardown(TeardownLocked)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
+
+// Single-threaded, with as many shards as the given thread count would get. An
+// order-statistic tree of the queued values gives each pop's rank.
+static void BM_MultiQueueRankError(benchmark::State & state)
+{
+  const int n = 1 << 14;
+  double totalError = 0;
+  size_t pops = 0;
+  for (auto _ : state) {
+    MultiQueue<std::uint32_t> queue(state.range(0));
+    RBTree<std::uint32_t> queued;
+    std::mt19937 rng(3);
+    for (int i = 0; i < n; ++i) {
+      std::uint32_t v = rng();
+      queue.push(v);
+      queued.insert(v);
+    }
+    std::uint32_t value;
+    while (queue.try_pop(value)) {
+      totalError += queued.rank(value);
+      queued.deleteNode(value);
+      ++pops;
+    }
+  }
+  state.counters["mean_rank_error"] = totalError / pops;
+}
+BENCHMARK(BM_MultiQueueRankError)->RangeMultiplier(2)->Range(1, 16)->Iterations(3);
@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+
+#include "../main.cpp"
+
+// Thread 0 is a writer that keeps inserting and deleting keys; every other thread looks up
+// random keys. Throughput counts reader lookups only, so it shows how well reads scale
+// while a writer is active.
+
+static const int key_range = 1 << 16;
+
+static PersistentBST<int> * persistent_tree;
+
+static void SetupPersistent(const benchmark::State &)
+{
+  persistent_tree = new PersistentBST<int>();
+  for (int i = 0; i < key_range; i += 2) persistent_tree->insert(i);
+}
+static void TeardownPersistent(const benchmark::State &) { delete persistent_tree; }
+
+static void BM_PersistentBSTReadersWithWriter(benchmark::State & state)
+{
+  std::mt19937 rng(state.thread_index());
+  int next = 1;
+  for (auto _ : state) {
+    if (state.thread_index() == 0) {
+      persistent_tree->insert(next);
+      persistent_tree->deleteNode(next);
+      next = (next + 2) % key_range;
+    } else {
+      benchmark::DoNotOptimize(persistent_tree->search(static_cast<int>(rng() % key_range)));
+    }
+  }
+  if (state.thread_index()) state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PersistentBSTReadersWithWriter)
+  ->Setup(SetupPersistent)
+  ->Teardown(TeardownPersistent)
+  ->ThreadRange(2, 16)
+  ->UseRealTime();
+
+struct LockedTree
+{
+  std::shared_mutex mutex;
+  RBTree<int> tree;
+};
+static LockedTree * locked_tree;
+
+static void SetupLocked(const benchmark::State &)
+{
+  locked_tree = new LockedTree();
+  for (int i = 0; i < key_range; i += 2) locked_tree->tree.insert(i);
+}
+static void TeardownLocked(const benchmark::State &) { delete locked_tree; }
+
+static void BM_SharedMutexBSTReadersWithWriter(benchmark::State & state)
+{
+  std::mt19937 rng(state.thread_index());
+  int next = 1;
+  for (auto _ : state) {
+    if (state.thread_index() == 0) {
+      std::unique_lock<std::shared_mutex> lock(locked_tree->mutex);
+      locked_tree->tree.insert(next);
+      locked_tree->tree.deleteNode(next);
+      next = (next + 2) % key_range;
+    } else {
+      std::shared_lock<std::shared_mutex> lock(locked_tree->mutex);
+      benchmark::DoNotOptimize(locked_tree->tree.search(static_cast<int>(rng() % key_range)));
+    }
+  }
+  if (state.thread_index()) state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SharedMutexBSTReadersWithWriter)
+  ->Setup(SetupLocked)
+  ->Teardown(TeardownLocked)
+  ->ThreadRange(2, 16)
+  ->UseRealTime();
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+#include <random>
+
+#include "../main.cpp"
+
+// Every thread runs the same mix on a shared ordered set of keys in [0, key_range): the
+// benchmark argument is the percentage of operations that are lookups, and the rest are
+// split evenly between inserts and erases of random keys, which keeps the set about half
+// full. ConcurrentSkipList is compared with an RBTree behind a single mutex.
+
+static const int key_range = 1 << 16;
+
+template <typename Set>
+static void runMix(Set & set, benchmark::State & state)
+{
+  std::mt19937 rng(state.thread_index() + 1);
+  const unsigned lookups = static_cast<unsigned>(state.range(0));
+  for (auto _ : state) {
+    int key = static_cast<int>(rng() % key_range);
+    unsigned op = rng() % 100;
+    if (op < lookups)
+      benchmark::DoNotOptimize(set.search(key));
+    else if (op % 2)
+      set.insert(key);
+    else
+      set.deleteNode(key);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static ConcurrentSkipList<int> * skip_list;
+
+static void SetupSkipList(const benchmark::State &)
+{
+  skip_list = new ConcurrentSkipList<int>();
+  for (int i = 0; i < key_range; i += 2) skip_list->insert(i);
+}
+static void TeardownSkipList(const benchmark::State &) { delete skip_list; }
+
+static void BM_SkipListMix(benchmark::State & state) { runMix(*skip_list, state); }
+
+// RBTree with every operation under one mutex, and insert made set-like so that both
+// containers hold the same keys
+struct LockedTree
+{
+  std::mutex mutex;
+  RBTree<int> tree;
+
+  bool search(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.search(key);
+  }
+  void insert(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!tree.search(key)) tree.insert(key);
+  }
+  void deleteNode(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tree.deleteNode(key);
+  }
+};
+
+static LockedTree * locked_tree;
+
+static void SetupLocked(const benchmark::State &)
+{
+  locked_tree = new LockedTree();
+  for (int i = 0; i < key_range; i += 2) locked_tree->tree.insert(i);
+}
+static void TeardownLocked(const benchmark::State &) { delete locked_tree; }
+
+static void BM_MutexRBTreeMix(benchmark::State & state) { runMix(*locked_tree, state); }
+
+BENCHMARK(BM_SkipListMix)
+  ->Setup(SetupSkipList)
+  ->Teardown(TeardownSkipList)
+  ->Arg(90)
+  ->Arg(50)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
+BENCHMARK(BM_MutexRBTreeMix)
+  ->Setup(SetupLocked)
+  ->Teardown(TeardownLocked)
+  ->Arg(90)
+  ->Arg(50)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
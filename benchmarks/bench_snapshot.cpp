@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "../main.cpp"
+
+// Restoring a tree of n random keys: re-inserting every key against loading a snapshot
+// written by BST::save, and against opening a SnapshotView, which only validates the file.
+// The snapshot sits in the page cache, so the load figures are an upper bound on what a
+// cold disk would give.
+
+static std::string snapshotPath(int64_t n)
+{
+  return "/tmp/algopack_bench_" + std::to_string(n) + ".snapshot";
+}
+
+static std::vector<int> randomKeys(int64_t n)
+{
+  std::vector<int> keys(n);
+  std::mt19937 rng(42);
+  for (int & key : keys) key = static_cast<int>(rng());
+  return keys;
+}
+
+static void BM_RebuildByInsert(benchmark::State & state)
+{
+  std::vector<int> keys = randomKeys(state.range(0));
+  for (auto _ : state) {
+    RBTree<int> tree;
+    for (int key : keys) tree.insert(key);
+    benchmark::DoNotOptimize(tree.getSize());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_SnapshotSave(benchmark::State & state)
+{
+  std::vector<int> keys = randomKeys(state.range(0));
+  RBTree<int> tree(keys.begin(), keys.end());
+  for (auto _ : state) tree.save(snapshotPath(state.range(0)));
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int));
+}
+
+static void BM_SnapshotLoad(benchmark::State & state)
+{
+  std::vector<int> keys = randomKeys(state.range(0));
+  RBTree<int>(keys.begin(), keys.end()).save(snapshotPath(state.range(0)));
+  for (auto _ : state) {
+    RBTree<int> tree = RBTree<int>::load(snapshotPath(state.range(0)));
+    benchmark::DoNotOptimize(tree.getSize());
+  }
+  std::remove(snapshotPath(state.range(0)).c_str());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int));
+}
+
+static void BM_SnapshotView(benchmark::State & state)
+{
+  std::vector<int> keys = randomKeys(state.range(0));
+  RBTree<int>(keys.begin(), keys.end()).save(snapshotPath(state.range(0)));
+  for (auto _ : state) {
+    SnapshotView<int> view(snapshotPath(state.range(0)));
+    benchmark::DoNotOptimize(view.search(keys[0]));
+  }
+  std::remove(snapshotPath(state.range(0)).c_str());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(int));
+}
+
+static void SnapshotSizes(benchmark::internal::Benchmark * b)
+{
+  b->RangeMultiplier(8)->Range(1 << 14, 1 << 23)->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_RebuildByInsert)->Apply(SnapshotSizes);
+BENCHMARK(BM_SnapshotSave)->Apply(SnapshotSizes);
+BENCHMARK(BM_SnapshotLoad)->Apply(SnapshotSizes);
+BENCHMARK(BM_SnapshotView)->Apply(SnapshotSizes);
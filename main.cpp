@@ -1,8 +1,551 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALGOPACK_HAVE_MMAP 1
+#endif
 using namespace std;
 
+// The bit scans and cache hints the containers need. GCC and Clang get their builtins; other
+// compilers fall back to plain loops, and to no prefetch at all, as it is only a hint.
+#if defined(__GNUC__) || defined(__clang__)
+#define ALGOPACK_HAVE_BUILTINS 1
+#endif
+
+inline void prefetch(const void * address)
+{
+#ifdef ALGOPACK_HAVE_BUILTINS
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+// Zero bits below the lowest set bit of x, which must not be 0
+inline int countTrailingZeros(std::uint64_t x)
+{
+#ifdef ALGOPACK_HAVE_BUILTINS
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  for (; !(x & 1); x >>= 1) ++n;
+  return n;
+#endif
+}
+
+// Zero bits above the highest set bit of x, which must not be 0
+inline int countLeadingZeros(std::uint64_t x)
+{
+#ifdef ALGOPACK_HAVE_BUILTINS
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  for (std::uint64_t bit = std::uint64_t(1) << 63; !(x & bit); bit >>= 1) ++n;
+  return n;
+#endif
+}
+
+// Fixed-size block pool. Blocks are carved out of contiguous slabs and freed blocks are
+// recycled through an intrusive free list, so a container that keeps pushing and popping
+// reaches a steady state with no calls into the global allocator. All slabs are returned
+// together by release() or when the pool is destroyed.
+class NodePool
+{
+private:
+  struct FreeBlock
+  {
+    FreeBlock * next;
+  };
+
+  static constexpr size_t initial_slab_blocks = 32;
+  static constexpr size_t max_slab_blocks = 4096;
+
+  size_t block_size;
+  size_t block_align;
+  size_t next_slab_blocks;
+  std::vector<void *> slabs;
+  FreeBlock * free_list;
+  char * cursor;
+  char * slab_end;
+
+  void grow()
+  {
+    size_t bytes = block_size * next_slab_blocks;
+    void * slab = ::operator new(bytes, std::align_val_t(block_align));
+    try {
+      slabs.push_back(slab);
+    } catch (...) {
+      ::operator delete(slab, std::align_val_t(block_align));
+      throw;
+    }
+    cursor = static_cast<char *>(slab);
+    slab_end = cursor + bytes;
+    if (next_slab_blocks < max_slab_blocks) next_slab_blocks *= 2;
+  }
+
+public:
+  // Size of the blocks a pool created with (size, align) hands out.
+  static size_t blockSizeFor(size_t size, size_t align)
+  {
+    if (align < alignof(FreeBlock)) align = alignof(FreeBlock);
+    if (size < sizeof(FreeBlock)) size = sizeof(FreeBlock);
+    return (size + align - 1) / align * align;
+  }
+
+  NodePool(size_t size, size_t align)
+      : block_size(blockSizeFor(size, align)),
+        block_align(align < alignof(FreeBlock) ? alignof(FreeBlock) : align),
+        next_slab_blocks(initial_slab_blocks),
+        free_list(nullptr),
+        cursor(nullptr),
+        slab_end(nullptr)
+  {
+  }
+
+  NodePool(const NodePool &) = delete;
+  NodePool & operator=(const NodePool &) = delete;
+
+  ~NodePool() { release(); }
+
+  void * allocate()
+  {
+    if (free_list) {
+      FreeBlock * block = free_list;
+      free_list = block->next;
+      return block;
+    }
+    if (cursor == slab_end) grow();
+    void * block = cursor;
+    cursor += block_size;
+    return block;
+  }
+
+  void deallocate(void * p) noexcept
+  {
+    FreeBlock * block = static_cast<FreeBlock *>(p);
+    block->next = free_list;
+    free_list = block;
+  }
+
+  // Returns every slab at once. Outstanding blocks become invalid.
+  void release() noexcept
+  {
+    for (void * slab : slabs) ::operator delete(slab, std::align_val_t(block_align));
+    slabs.clear();
+    free_list = nullptr;
+    cursor = slab_end = nullptr;
+    next_slab_blocks = initial_slab_blocks;
+  }
+
+  size_t getBlockSize() const noexcept { return block_size; }
+  size_t getBlockAlign() const noexcept { return block_align; }
+  size_t getSlabCount() const noexcept { return slabs.size(); }
+};
+
+// One NodePool per distinct block size, shared by an allocator and all of its rebinds.
+class NodePoolSet
+{
+private:
+  std::vector<std::unique_ptr<NodePool>> pools;
+
+public:
+  NodePool * get(size_t size, size_t align)
+  {
+    for (auto & pool : pools)
+      if (pool->getBlockSize() == NodePool::blockSizeFor(size, align) &&
+          pool->getBlockAlign() >= align)
+        return pool.get();
+    pools.push_back(std::make_unique<NodePool>(size, align));
+    return pools.back().get();
+  }
+};
+
+// Allocator backed by NodePool. Single-object allocations (one container node at a time)
+// come from a pool sized for the rebound type; array allocations fall through to
+// std::allocator. Copies and rebinds share the same set of pools, which is released in
+// bulk when the last copy goes away. Not thread-safe.
+template <typename T>
+class PoolAllocator
+{
+private:
+  template <typename U>
+  friend class PoolAllocator;
+
+  std::shared_ptr<NodePoolSet> pools;
+  NodePool * pool;
+
+  NodePool * getPool()
+  {
+    if (!pool) pool = pools->get(sizeof(T), alignof(T));
+    return pool;
+  }
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  template <typename U>
+  struct rebind
+  {
+    using other = PoolAllocator<U>;
+  };
+
+  PoolAllocator() : pools(std::make_shared<NodePoolSet>()), pool(nullptr) {}
+  // Copy-only on purpose: a moved-from allocator must still be able to serve its container.
+  PoolAllocator(const PoolAllocator & other) = default;
+  PoolAllocator & operator=(const PoolAllocator & other) = default;
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> & other) : pools(other.pools), pool(nullptr)
+  {
+  }
+
+  T * allocate(size_t n)
+  {
+    if (n != 1) return std::allocator<T>().allocate(n);
+    return static_cast<T *>(getPool()->allocate());
+  }
+
+  void deallocate(T * p, size_t n)
+  {
+    if (n != 1)
+      std::allocator<T>().deallocate(p, n);
+    else
+      getPool()->deallocate(p);
+  }
+
+  // A copied container gets pools of its own rather than sharing the source's.
+  PoolAllocator select_on_container_copy_construction() const { return PoolAllocator(); }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U> & other) const noexcept
+  {
+    return pools == other.pools;
+  }
+
+  template <typename U>
+  bool operator!=(const PoolAllocator<U> & other) const noexcept
+  {
+    return pools != other.pools;
+  }
+};
+
+// Instrumentation policies for the Stats parameter of LinkedList and BST. A container
+// derives privately from its policy and reports events through the hooks below. NoStats
+// makes every hook an empty inline function and, as an empty base, takes no space, so the
+// default costs nothing. CountingStats keeps plain (non-atomic) counters, and stats() on
+// the container returns a copy of them. A custom policy needs the same hooks, an enabled
+// flag and, when enabled, a height member for BST::stats() to fill in.
+struct NoStats
+{
+  static constexpr bool enabled = false;
+
+  void onAllocate() {}
+  void onFree() {}
+  void onPush() {}
+  void onPop() {}
+  void onSearch(size_t, size_t) {}
+  void onInsert(size_t) {}
+  void onRotation() {}
+};
+
+struct CountingStats
+{
+  static constexpr bool enabled = true;
+
+  size_t allocations = 0;
+  size_t frees = 0;
+  size_t pushes = 0;         // LinkedList elements added (push, emplace, insert, splice, merge)
+  size_t pops = 0;           // LinkedList elements removed (pop, erase, remove_if, splice, merge)
+  size_t searches = 0;       // BST lookups by value (search, deleteNode, rotations)
+  size_t comparisons = 0;    // key comparisons made by those lookups
+  size_t nodes_visited = 0;  // nodes those lookups stepped on
+  size_t rotations = 0;      // BST rotations, including rebalancing ones
+  size_t max_height = 0;     // deepest level a BST insertion has reached
+  size_t height = 0;         // BST height at the time of the snapshot
+
+  void onAllocate() { ++allocations; }
+  void onFree() { ++frees; }
+  void onPush() { ++pushes; }
+  void onPop() { ++pops; }
+  void onSearch(size_t visited, size_t compared)
+  {
+    ++searches;
+    nodes_visited += visited;
+    comparisons += compared;
+  }
+  void onInsert(size_t depth) { max_height = std::max(max_height, depth); }
+  void onRotation() { ++rotations; }
+};
+
+// Binary snapshots of containers of trivially copyable values. A snapshot is a 64-byte
+// header followed by the elements exactly as they sit in memory, so loading is a single
+// sequential read and a SnapshotView can serve the values straight from the mapped file.
+// Snapshots are only portable between builds with the same element layout and byte order,
+// both of which the header records and the loader checks.
+struct SnapshotHeader
+{
+  static constexpr char expected_magic[8] = {'A', 'L', 'G', 'O', 'P', 'A', 'C', 'K'};
+  static constexpr uint32_t current_version = 1;
+  static constexpr uint32_t native_byte_order = 0x01020304;
+  static constexpr uint64_t sorted_flag = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t element_size;
+  uint64_t element_align;
+  uint64_t count;
+  uint64_t flags;
+  uint64_t checksum;  // of the payload, see SnapshotChecksum
+  uint64_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "the payload starts on a 64-byte boundary");
+
+// Word-at-a-time hash of the payload. Every step is a bijection of both the running value
+// and the input word, so any change confined to one word always changes the result, and it
+// runs far faster than a byte-wise CRC.
+class SnapshotChecksum
+{
+private:
+  uint64_t h = 0x9E3779B97F4A7C15ull;
+
+  void mix(uint64_t word)
+  {
+    h ^= word;
+    h = (h << 29 | h >> 35) * 0xBF58476D1CE4E5B9ull;
+  }
+
+public:
+  // bytes must be a multiple of 8 long except on the last call
+  void update(const void * bytes, size_t n)
+  {
+    const unsigned char * p = static_cast<const unsigned char *>(bytes);
+    uint64_t word;
+    for (; n >= 8; p += 8, n -= 8) {
+      std::memcpy(&word, p, 8);
+      mix(word);
+    }
+    if (n) {
+      word = 0;
+      std::memcpy(&word, p, n);
+      mix(word);
+    }
+  }
+
+  uint64_t value() const { return h; }
+};
+
+// Writes count values from first as a snapshot at path, replacing any existing file
+template <typename T, typename InputIt>
+void writeSnapshot(const std::string & path, InputIt first, size_t count, bool sorted)
+{
+  static_assert(std::is_trivially_copyable_v<T>, "snapshots hold raw bytes of the values");
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("Cannot create snapshot file " + path);
+
+  SnapshotHeader header = {};
+  std::memcpy(header.magic, SnapshotHeader::expected_magic, sizeof(header.magic));
+  header.version = SnapshotHeader::current_version;
+  header.byte_order = SnapshotHeader::native_byte_order;
+  header.element_size = sizeof(T);
+  header.element_align = alignof(T);
+  header.count = count;
+  header.flags = sorted ? SnapshotHeader::sorted_flag : 0;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // A chunk of 8192 values is a multiple of 8 bytes, as SnapshotChecksum::update requires
+  std::vector<T> chunk;
+  chunk.reserve(8192);
+  SnapshotChecksum checksum;
+  for (size_t written = 0; written < count; written += chunk.size()) {
+    chunk.clear();
+    for (; chunk.size() < chunk.capacity() && written + chunk.size() < count; ++first)
+      chunk.push_back(*first);
+    checksum.update(chunk.data(), chunk.size() * sizeof(T));
+    out.write(reinterpret_cast<const char *>(chunk.data()), chunk.size() * sizeof(T));
+  }
+  header.checksum = checksum.value();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.close();
+  if (!out) throw std::runtime_error("Cannot write snapshot file " + path);
+}
+
+// Read-only contents of a file, memory mapped where the platform allows and read into an
+// aligned buffer otherwise
+class MappedFile
+{
+private:
+  const unsigned char * bytes = nullptr;
+  size_t length = 0;
+#ifndef ALGOPACK_HAVE_MMAP
+  std::vector<std::max_align_t> buffer;
+#endif
+
+  void release() noexcept
+  {
+#ifdef ALGOPACK_HAVE_MMAP
+    if (length) munmap(const_cast<unsigned char *>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+  }
+
+public:
+  explicit MappedFile(const std::string & path)
+  {
+#ifdef ALGOPACK_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Cannot read " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length) {
+      void * mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        ::close(fd);
+        length = 0;
+        throw std::runtime_error("Cannot map " + path);
+      }
+      // Loads read the file front to back once; let the kernel read ahead aggressively
+      madvise(mapped, length, MADV_SEQUENTIAL);
+      bytes = static_cast<const unsigned char *>(mapped);
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    length = static_cast<size_t>(in.tellg());
+    buffer.resize((length + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+    in.seekg(0);
+    in.read(reinterpret_cast<char *>(buffer.data()), length);
+    if (!in) throw std::runtime_error("Cannot read " + path);
+    bytes = reinterpret_cast<const unsigned char *>(buffer.data());
+#endif
+  }
+
+  MappedFile(MappedFile && other) noexcept
+      : bytes(std::exchange(other.bytes, nullptr)), length(std::exchange(other.length, 0))
+  {
+#ifndef ALGOPACK_HAVE_MMAP
+    buffer = std::move(other.buffer);
+#endif
+  }
+
+  MappedFile & operator=(MappedFile && other) noexcept
+  {
+    if (this == &other) return *this;
+    release();
+    bytes = std::exchange(other.bytes, nullptr);
+    length = std::exchange(other.length, 0);
+#ifndef ALGOPACK_HAVE_MMAP
+    buffer = std::move(other.buffer);
+#endif
+    return *this;
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  ~MappedFile() { release(); }
+
+  const unsigned char * data() const { return bytes; }
+  size_t getSize() const { return length; }
+};
+
+// The values of a snapshot served in place from the mapped file. Opening checks the header
+// and the checksum, which reads the file once; after that nothing is copied. Snapshots
+// written by BST are sorted, and search on them is a binary search.
 template <typename T>
-class LinkedList
+class SnapshotView
+{
+  static_assert(std::is_trivially_copyable_v<T>, "snapshots hold raw bytes of the values");
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "the payload is only guaranteed max_align_t alignment");
+
+private:
+  MappedFile file;
+  const T * values = nullptr;
+  size_t count = 0;
+  bool ordered = false;
+
+public:
+  explicit SnapshotView(const std::string & path) : file(path)
+  {
+    SnapshotHeader header;
+    if (file.getSize() < sizeof(header)) throw std::runtime_error("Not a snapshot file: " + path);
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, SnapshotHeader::expected_magic, sizeof(header.magic)) != 0)
+      throw std::runtime_error("Not a snapshot file: " + path);
+    if (header.version != SnapshotHeader::current_version)
+      throw std::runtime_error("Unsupported snapshot version in " + path);
+    if (header.byte_order != SnapshotHeader::native_byte_order)
+      throw std::runtime_error("Snapshot was written with a different byte order: " + path);
+    if (header.element_size != sizeof(T) || header.element_align != alignof(T))
+      throw std::runtime_error("Snapshot holds a different element type: " + path);
+    if (header.count != (file.getSize() - sizeof(header)) / sizeof(T) ||
+        (file.getSize() - sizeof(header)) % sizeof(T) != 0)
+      throw std::runtime_error("Snapshot is truncated or padded: " + path);
+
+    const unsigned char * payload = file.data() + sizeof(header);
+    SnapshotChecksum checksum;
+    checksum.update(payload, header.count * sizeof(T));
+    if (checksum.value() != header.checksum)
+      throw std::runtime_error("Snapshot checksum mismatch: " + path);
+
+    values = reinterpret_cast<const T *>(payload);
+    count = header.count;
+    ordered = header.flags & SnapshotHeader::sorted_flag;
+  }
+
+  size_t getSize() const { return count; }
+  bool empty() const { return count == 0; }
+  bool sorted() const { return ordered; }
+
+  const T * begin() const { return values; }
+  const T * end() const { return values + count; }
+  const T & operator[](size_t i) const { return values[i]; }
+
+  bool search(const T & value) const
+  {
+    if (ordered) return std::binary_search(begin(), end(), value);
+    return std::find(begin(), end(), value) != end();
+  }
+};
+
+template <typename T, typename Allocator = std::allocator<T>, typename Stats = NoStats>
+class LinkedList : private Stats
 {
 private:
   struct Node
@@ -11,34 +554,45 @@ private:
     Node * next;
     Node * prev;
 
-    Node(const T & value) : data(value), next(nullptr), prev(nullptr) {}
+    template <typename... Args>
+    Node(std::in_place_t, Args &&... args)
+        : data(std::forward<Args>(args)...), next(nullptr), prev(nullptr)
+    {
+    }
   };
 
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
   Node * head;
   Node * tail;
   size_t size;
+  NodeAllocator alloc;
 
-public:
-  class iterator;
-  class const_iterator;
-  class reverse_iterator;
-  class const_reverse_iterator;
-
-  LinkedList() : head(nullptr), tail(nullptr), size(0) {}
-
-  ~LinkedList()
+  template <typename... Args>
+  Node * createNode(Args &&... args)
   {
-    Node * current = head;
-    while (current) {
-      Node * next = current->next;
-      delete current;
-      current = next;
+    Node * node = NodeTraits::allocate(alloc, 1);
+    Stats::onAllocate();
+    try {
+      NodeTraits::construct(alloc, node, std::in_place, std::forward<Args>(args)...);
+    } catch (...) {
+      NodeTraits::deallocate(alloc, node, 1);
+      Stats::onFree();
+      throw;
     }
+    return node;
   }
 
-  void push_back(const T & value)
+  void destroyNode(Node * node)
+  {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
+    Stats::onFree();
+  }
+
+  void linkBack(Node * newNode)
   {
-    Node * newNode = new Node(value);
     if (empty()) {
       head = tail = newNode;
     } else {
@@ -47,11 +601,11 @@ public:
       tail = newNode;
     }
     ++size;
+    Stats::onPush();
   }
 
-  void push_front(const T & value)
+  void linkFront(Node * newNode)
   {
-    Node * newNode = new Node(value);
     if (empty()) {
       head = tail = newNode;
     } else {
@@ -60,96 +614,547 @@ public:
       head = newNode;
     }
     ++size;
+    Stats::onPush();
   }
 
-  void pop_back()
+  void stealFrom(LinkedList & other) noexcept
   {
-    if (empty()) {
-      throw out_of_range("Cannot pop from empty list");
-    }
-    Node * temp = tail;
-    if (head == tail) {
-      head = tail = nullptr;
-    } else {
-      tail = tail->prev;
-      tail->next = nullptr;
-    }
-    delete temp;
-    --size;
+    head = other.head;
+    tail = other.tail;
+    size = other.size;
+    other.head = other.tail = nullptr;
+    other.size = 0;
   }
 
-  void pop_front()
+  // Overwrites the list with the elements of other, reusing the nodes already held and only
+  // allocating (or freeing) the difference in length.
+  template <typename List>
+  void assignFrom(List && other)
   {
-    if (empty()) {
-      throw out_of_range("Cannot pop from empty list");
+    Node * dst = head;
+    Node * src = other.head;
+    for (; dst && src; dst = dst->next, src = src->next) {
+      if constexpr (std::is_lvalue_reference_v<List>)
+        dst->data = src->data;
+      else
+        dst->data = std::move(src->data);
     }
-    Node * temp = head;
-    if (head == tail) {
-      head = tail = nullptr;
-    } else {
-      head = head->next;
-      head->prev = nullptr;
+    for (; src; src = src->next) {
+      if constexpr (std::is_lvalue_reference_v<List>)
+        push_back(src->data);
+      else
+        push_back(std::move(src->data));
     }
-    delete temp;
-    --size;
+    while (size > other.size) pop_back();
   }
 
-  bool empty() const noexcept { return size == 0; }
-  size_t getSize() const noexcept { return size; }
-
-  iterator begin() { return iterator(head); }
-  iterator end() { return iterator(nullptr); }
-  const_iterator cbegin() const { return const_iterator(head); }
-  const_iterator cend() const { return const_iterator(nullptr); }
-
-  reverse_iterator rbegin() { return reverse_iterator(tail); }
-  reverse_iterator rend() { return reverse_iterator(nullptr); }
-  const_reverse_iterator crbegin() const { return const_reverse_iterator(tail); }
-  const_reverse_iterator crend() const { return const_reverse_iterator(nullptr); }
+  // The sorting helpers work on chains linked through next only and terminated by nullptr;
+  // relinkChain restores prev and tail once the final order is known.
 
-  class iterator
+  // Detaches the chain after the first n nodes starting at x and returns it
+  static Node * cutAfter(Node * x, size_t n)
   {
-  private:
-    Node * current;
-    explicit iterator(Node * node) : current(node) {}
-    friend class LinkedList;
+    if (!x) return nullptr;
+    for (; n > 1 && x->next; --n) x = x->next;
+    Node * rest = x->next;
+    x->next = nullptr;
+    return rest;
+  }
 
-  public:
-    T & operator*() { return current->data; }
-    iterator & operator++()
-    {
-      current = current->next;
-      return *this;
-    }
-    iterator operator++(int)
-    {
-      iterator temp = *this;
-      current = current->next;
-      return temp;
+  // Stable merge of chains a and b; ties take from a
+  template <typename Compare>
+  static Node * mergeChains(Node * a, Node * b, Compare & comp)
+  {
+    Node * first = nullptr;
+    Node ** out = &first;
+    while (a && b) {
+      if (comp(b->data, a->data)) {
+        *out = b;
+        b = b->next;
+      } else {
+        *out = a;
+        a = a->next;
+      }
+      out = &(*out)->next;
     }
-    iterator & operator--()
-    {
-      current = current->prev;
-      return *this;
+    *out = a ? a : b;
+    return first;
+  }
+
+  // Bottom-up merge sort driven like a binary counter: runs[i] holds a sorted run of 2^i
+  // nodes or nothing, and each node taken off the chain is carried up through the occupied
+  // slots. Merges stay among recently touched nodes, which keeps the sort cache friendly,
+  // and the extra space is one pointer per bit of the size.
+  template <typename Compare>
+  static Node * sortChain(Node * first, Compare & comp)
+  {
+    Node * runs[std::numeric_limits<size_t>::digits] = {};
+    size_t used = 0;
+    while (first) {
+      Node * run = first;
+      first = first->next;
+      run->next = nullptr;
+      size_t i = 0;
+      for (; i < used && runs[i]; ++i) {
+        run = mergeChains(runs[i], run, comp);
+        runs[i] = nullptr;
+      }
+      if (i == used) ++used;
+      runs[i] = run;
     }
-    iterator operator--(int)
-    {
-      iterator temp = *this;
-      current = current->prev;
-      return temp;
+    // Higher slots hold earlier elements, so they go first to keep the sort stable
+    Node * sorted = nullptr;
+    for (size_t i = 0; i < used; ++i) {
+      if (runs[i]) sorted = mergeChains(runs[i], sorted, comp);
     }
-    bool operator==(const iterator & other) const { return current == other.current; }
-    bool operator!=(const iterator & other) const { return current != other.current; }
-  };
+    return sorted;
+  }
 
-  class const_iterator
+  // Lists shorter than this are sorted on the calling thread
+  static constexpr size_t parallel_grain = size_t(1) << 14;
+
+  // Sorts the two halves of the chain concurrently while forks remain and merges them
+  template <typename Compare>
+  static Node * sortChainParallel(Node * first, size_t n, Compare & comp, unsigned forks)
   {
-  private:
-    const Node * current;
-    explicit const_iterator(const Node * node) : current(node) {}
-    friend class LinkedList;
+    if (!forks || n < parallel_grain) return sortChain(first, comp);
+    size_t half = n / 2;
+    Node * second = cutAfter(first, half);
+    auto task = std::async(std::launch::async | std::launch::deferred, [&] {
+      Compare local = comp;
+      return sortChainParallel(second, n - half, local, forks / 2);
+    });
+    first = sortChainParallel(first, half, comp, forks / 2);
+    return mergeChains(first, task.get(), comp);
+  }
 
-  public:
+  void relinkChain(Node * first)
+  {
+    head = first;
+    tail = nullptr;
+    for (Node * x = first; x; x = x->next) {
+      x->prev = tail;
+      tail = x;
+    }
+  }
+
+  // Links the detached run first..last (inclusive) in before pos, or at the back when pos
+  // is null. Sizes are left to the caller.
+  void linkRunBefore(Node * pos, Node * first, Node * last)
+  {
+    Node * before = pos ? pos->prev : tail;
+    first->prev = before;
+    last->next = pos;
+    if (before)
+      before->next = first;
+    else
+      head = first;
+    if (pos)
+      pos->prev = last;
+    else
+      tail = last;
+  }
+
+  // Counts n elements that splice or merge relinked from other into this list as pops from
+  // other and pushes here, so that the Stats counters follow the elements as they would for
+  // push and erase
+  void countTransfer(LinkedList & other, size_t n)
+  {
+    if constexpr (Stats::enabled) {
+      for (size_t i = 0; i < n; ++i) {
+        other.Stats::onPop();
+        Stats::onPush();
+      }
+    }
+  }
+
+  // Detaches the run first..last (inclusive), closing the gap it leaves
+  void unlinkRun(Node * first, Node * last)
+  {
+    if (first->prev)
+      first->prev->next = last->next;
+    else
+      head = last->next;
+    if (last->next)
+      last->next->prev = first->prev;
+    else
+      tail = first->prev;
+  }
+
+public:
+  class iterator;
+  class const_iterator;
+  class reverse_iterator;
+  class const_reverse_iterator;
+
+  using allocator_type = Allocator;
+
+  LinkedList() : LinkedList(Allocator()) {}
+  explicit LinkedList(const Allocator & allocator)
+      : head(nullptr), tail(nullptr), size(0), alloc(allocator)
+  {
+  }
+
+  LinkedList(const LinkedList & other)
+      : LinkedList(Allocator(NodeTraits::select_on_container_copy_construction(other.alloc)))
+  {
+    for (Node * current = other.head; current; current = current->next) push_back(current->data);
+  }
+
+  LinkedList(LinkedList && other) noexcept
+      : head(nullptr), tail(nullptr), size(0), alloc(std::move(other.alloc))
+  {
+    stealFrom(other);
+  }
+
+  LinkedList & operator=(const LinkedList & other)
+  {
+    if (this == &other) return *this;
+    if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) {
+      if (alloc != other.alloc) clear();
+      alloc = other.alloc;
+    }
+    assignFrom(other);
+    return *this;
+  }
+
+  LinkedList & operator=(LinkedList && other) noexcept(
+    NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+      clear();
+      alloc = std::move(other.alloc);
+      stealFrom(other);
+    } else {
+      if (alloc == other.alloc) {
+        clear();
+        stealFrom(other);
+      } else {
+        assignFrom(std::move(other));
+        other.clear();
+      }
+    }
+    return *this;
+  }
+
+  ~LinkedList() { clear(); }
+
+  allocator_type get_allocator() const { return allocator_type(alloc); }
+
+  // Copy of the counters gathered by the Stats policy since construction or the last reset
+  Stats stats() const { return static_cast<const Stats &>(*this); }
+  void reset_stats() { static_cast<Stats &>(*this) = Stats(); }
+
+  void clear() noexcept
+  {
+    Node * current = head;
+    while (current) {
+      Node * next = current->next;
+      destroyNode(current);
+      current = next;
+    }
+    head = tail = nullptr;
+    size = 0;
+  }
+
+  void push_back(const T & value) { linkBack(createNode(value)); }
+  void push_back(T && value) { linkBack(createNode(std::move(value))); }
+
+  void push_front(const T & value) { linkFront(createNode(value)); }
+  void push_front(T && value) { linkFront(createNode(std::move(value))); }
+
+  template <typename... Args>
+  T & emplace_back(Args &&... args)
+  {
+    linkBack(createNode(std::forward<Args>(args)...));
+    return tail->data;
+  }
+
+  template <typename... Args>
+  T & emplace_front(Args &&... args)
+  {
+    linkFront(createNode(std::forward<Args>(args)...));
+    return head->data;
+  }
+
+  void pop_back()
+  {
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
+    }
+    Node * temp = tail;
+    if (head == tail) {
+      head = tail = nullptr;
+    } else {
+      tail = tail->prev;
+      tail->next = nullptr;
+    }
+    destroyNode(temp);
+    --size;
+    Stats::onPop();
+  }
+
+  void pop_front()
+  {
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
+    }
+    Node * temp = head;
+    if (head == tail) {
+      head = tail = nullptr;
+    } else {
+      head = head->next;
+      head->prev = nullptr;
+    }
+    destroyNode(temp);
+    --size;
+    Stats::onPop();
+  }
+
+  // Stable O(n log n) sort that relinks the existing nodes; nothing is allocated, copied or
+  // moved, so iterators stay valid and keep pointing at the same elements
+  template <typename Compare = std::less<>>
+  void sort(Compare comp = Compare())
+  {
+    relinkChain(sortChain(head, comp));
+  }
+
+  // Same result as sort, with the halves of large lists sorted on up to threads threads.
+  // Each task gets its own copy of comp.
+  template <typename Compare = std::less<>>
+  void parallel_sort(Compare comp = Compare(),
+                     unsigned threads = std::thread::hardware_concurrency())
+  {
+    relinkChain(sortChainParallel(head, size, comp, std::max(1u, threads) - 1));
+  }
+
+  // Merges other, which must be sorted by comp like this list, into this one and leaves it
+  // empty. Equal elements of this list come first. Nodes move across without reallocation
+  // when the allocators compare equal; otherwise the elements are moved into new nodes.
+  template <typename Compare = std::less<>>
+  void merge(LinkedList & other, Compare comp = Compare())
+  {
+    if (this == &other || other.empty()) return;
+    if (!(alloc == other.alloc)) {
+      LinkedList adopted(get_allocator());
+      for (Node * x = other.head; x; x = x->next) adopted.push_back(std::move(x->data));
+      other.erase(other.begin(), other.end());
+      merge(adopted, comp);
+      return;
+    }
+    relinkChain(mergeChains(head, other.head, comp));
+    countTransfer(other, other.size);
+    size += other.size;
+    other.head = other.tail = nullptr;
+    other.size = 0;
+  }
+
+  template <typename Compare = std::less<>>
+  void merge(LinkedList && other, Compare comp = Compare())
+  {
+    merge(other, comp);
+  }
+
+  // Inserts before pos (end() appends) and returns an iterator to the new element
+  iterator insert(iterator pos, const T & value) { return emplace(pos, value); }
+  iterator insert(iterator pos, T && value) { return emplace(pos, std::move(value)); }
+
+  template <typename... Args>
+  iterator emplace(iterator pos, Args &&... args)
+  {
+    Node * node = createNode(std::forward<Args>(args)...);
+    linkRunBefore(pos.current, node, node);
+    ++size;
+    Stats::onPush();
+    return iterator(node);
+  }
+
+  // Removes the element at pos and returns an iterator to the one after it. Other iterators
+  // stay valid.
+  iterator erase(iterator pos)
+  {
+    Node * x = pos.current;
+    if (!x) throw out_of_range("Cannot erase the end of the list");
+    Node * next = x->next;
+    unlinkRun(x, x);
+    destroyNode(x);
+    --size;
+    Stats::onPop();
+    return iterator(next);
+  }
+
+  // Removes [first, last), which is cut out of the list in one step before its nodes are
+  // freed, and returns last
+  iterator erase(iterator first, iterator last)
+  {
+    if (first == last) return last;
+    Node * end = last.current;
+    unlinkRun(first.current, end ? end->prev : tail);
+    for (Node * x = first.current; x != end;) {
+      Node * next = x->next;
+      destroyNode(x);
+      --size;
+      Stats::onPop();
+      x = next;
+    }
+    return last;
+  }
+
+  // Removes every element for which pred returns true and returns how many there were
+  template <typename Predicate>
+  size_t remove_if(Predicate pred)
+  {
+    size_t removed = 0;
+    for (Node * x = head; x;) {
+      Node * next = x->next;
+      if (pred(x->data)) {
+        unlinkRun(x, x);
+        destroyNode(x);
+        --size;
+        Stats::onPop();
+        ++removed;
+      }
+      x = next;
+    }
+    return removed;
+  }
+
+  // The splices move elements of other in front of pos by relinking their nodes, without
+  // allocating, copying or moving any element; iterators to them stay valid and now refer
+  // into this list. The whole-list and single-element forms take O(1), the range form
+  // O(length of the range) to count it when other is a different list. With unequal
+  // allocators the elements are moved into new nodes instead, as for merge. CountingStats
+  // sees every element that changes lists as popped from other and pushed here, which
+  // takes O(elements moved) when counting is enabled.
+  void splice(iterator pos, LinkedList & other)
+  {
+    if (this == &other || other.empty()) return;
+    if (!(alloc == other.alloc)) {
+      for (Node * x = other.head; x; x = x->next) emplace(pos, std::move(x->data));
+      other.erase(other.begin(), other.end());
+      return;
+    }
+    linkRunBefore(pos.current, other.head, other.tail);
+    countTransfer(other, other.size);
+    size += other.size;
+    other.head = other.tail = nullptr;
+    other.size = 0;
+  }
+  void splice(iterator pos, LinkedList && other) { splice(pos, other); }
+
+  // Moves the element at it, which belongs to other
+  void splice(iterator pos, LinkedList & other, iterator it)
+  {
+    Node * x = it.current;
+    if (this == &other && (x == pos.current || x->next == pos.current)) return;
+    if (!(alloc == other.alloc)) {
+      emplace(pos, std::move(x->data));
+      other.erase(it);
+      return;
+    }
+    other.unlinkRun(x, x);
+    --other.size;
+    linkRunBefore(pos.current, x, x);
+    ++size;
+    if (this != &other) countTransfer(other, 1);
+  }
+  void splice(iterator pos, LinkedList && other, iterator it) { splice(pos, other, it); }
+
+  // Moves [first, last), a range of other that must not contain pos
+  void splice(iterator pos, LinkedList & other, iterator first, iterator last)
+  {
+    if (first == last || first == pos) return;
+    if (!(alloc == other.alloc)) {
+      for (iterator it = first; it != last; ++it) emplace(pos, std::move(*it));
+      other.erase(first, last);
+      return;
+    }
+    Node * end = last.current;
+    Node * back = end ? end->prev : other.tail;
+    if (this != &other) {
+      size_t n = 1;
+      for (Node * x = first.current; x != back; x = x->next) ++n;
+      other.size -= n;
+      size += n;
+      countTransfer(other, n);
+    }
+    other.unlinkRun(first.current, back);
+    linkRunBefore(pos.current, first.current, back);
+  }
+  void splice(iterator pos, LinkedList && other, iterator first, iterator last)
+  {
+    splice(pos, other, first, last);
+  }
+
+  // Writes the values, front to back, to a snapshot file (see SnapshotHeader)
+  void save(const std::string & path) const { writeSnapshot<T>(path, cbegin(), size, false); }
+
+  // Rebuilds a list from a snapshot file in one pass over the mapped values
+  static LinkedList load(const std::string & path, const Allocator & allocator = Allocator())
+  {
+    SnapshotView<T> view(path);
+    LinkedList list(allocator);
+    for (const T & value : view) list.push_back(value);
+    return list;
+  }
+
+  bool empty() const noexcept { return size == 0; }
+  size_t getSize() const noexcept { return size; }
+
+  iterator begin() { return iterator(head); }
+  iterator end() { return iterator(nullptr); }
+  const_iterator cbegin() const { return const_iterator(head); }
+  const_iterator cend() const { return const_iterator(nullptr); }
+
+  reverse_iterator rbegin() { return reverse_iterator(tail); }
+  reverse_iterator rend() { return reverse_iterator(nullptr); }
+  const_reverse_iterator crbegin() const { return const_reverse_iterator(tail); }
+  const_reverse_iterator crend() const { return const_reverse_iterator(nullptr); }
+
+  class iterator
+  {
+  private:
+    Node * current;
+    explicit iterator(Node * node) : current(node) {}
+    friend class LinkedList;
+
+  public:
+    T & operator*() { return current->data; }
+    iterator & operator++()
+    {
+      current = current->next;
+      return *this;
+    }
+    iterator operator++(int)
+    {
+      iterator temp = *this;
+      current = current->next;
+      return temp;
+    }
+    iterator & operator--()
+    {
+      current = current->prev;
+      return *this;
+    }
+    iterator operator--(int)
+    {
+      iterator temp = *this;
+      current = current->prev;
+      return temp;
+    }
+    bool operator==(const iterator & other) const { return current == other.current; }
+    bool operator!=(const iterator & other) const { return current != other.current; }
+  };
+
+  class const_iterator
+  {
+  private:
+    const Node * current;
+    explicit const_iterator(const Node * node) : current(node) {}
+    friend class LinkedList;
+
+  public:
     const T & operator*() const { return current->data; }
     const_iterator & operator++()
     {
@@ -248,267 +1253,250 @@ public:
   };
 };
 
-template <typename T>
-class BST
+template <typename T, typename Hook>
+class IntrusiveList;
+
+// Links embedded in an object so that IntrusiveList can chain it without allocating. Use it
+// as a base class (one per Tag, for an object that sits in several lists) or as a member.
+// Copying an object never copies its links: the copy starts out unlinked.
+template <typename Tag = void>
+class IntrusiveListHook
 {
 private:
-  struct Node
-  {
-    T data;
-    Node * parent;
-    Node * left;
-    Node * right;
+  IntrusiveListHook * next = nullptr;
+  IntrusiveListHook * prev = nullptr;
 
-    Node(const T & value) : data(value), parent(nullptr), left(nullptr), right(nullptr) {}
-  };
+  template <typename T, typename Hook>
+  friend class IntrusiveList;
 
-  Node * root;
-  size_t size;
+public:
+  IntrusiveListHook() = default;
+  IntrusiveListHook(const IntrusiveListHook &) {}
+  IntrusiveListHook & operator=(const IntrusiveListHook &) { return *this; }
 
-  Node * getMinimumPtr(Node * x)
-  {
-    while (x->left) x = x->left;
-    return x;
-  }
+  bool is_linked() const { return next != nullptr; }
+};
+
+// Hook policies for IntrusiveList: they convert between an object and the hook the list
+// uses. IntrusiveBaseHook picks the IntrusiveListHook<Tag> base of T.
+template <typename T, typename Tag = void>
+struct IntrusiveBaseHook
+{
+  using hook_type = IntrusiveListHook<Tag>;
+
+  static hook_type * toHook(T * object) { return object; }
+  static T * toObject(hook_type * hook) { return static_cast<T *>(hook); }
+};
+
+// IntrusiveMemberHook picks a data member of T, as in IntrusiveMemberHook<Task, &Task::hook>
+template <typename T, IntrusiveListHook<> T::*Member>
+struct IntrusiveMemberHook
+{
+  using hook_type = IntrusiveListHook<>;
 
-  Node * getMaximumPtr(Node * x)
+  static hook_type * toHook(T * object) { return &(object->*Member); }
+  static T * toObject(hook_type * hook)
   {
-    while (x->right) x = x->right;
-    return x;
+    return reinterpret_cast<T *>(reinterpret_cast<char *>(hook) - offset());
   }
 
-  void transplant(Node * u, Node * v)
+private:
+  // Offset of the member within T, measured on uninitialised storage (offsetof cannot take a
+  // member pointer)
+  static size_t offset()
   {
-    if (!(u->parent))
-      root = v;
-    else if (u == u->parent->left)
-      u->parent->left = v;
-    else
-      u->parent->right = v;
-    if (v) v->parent = u->parent;
+    alignas(T) static const unsigned char storage[sizeof(T)] = {};
+    const T * object = reinterpret_cast<const T *>(storage);
+    return reinterpret_cast<const char *>(&(object->*Member)) -
+           reinterpret_cast<const char *>(object);
   }
+};
+
+// Doubly linked list of objects that carry their own links (see IntrusiveListHook). The list
+// never allocates, copies or destroys elements: it only links the objects it is given, which
+// must outlive their membership, and any of them can be removed in O(1) given just the
+// object. The links form a ring through a sentinel hook held by the list itself, so
+// decrementing end() reaches the last element.
+template <typename T, typename Hook = IntrusiveBaseHook<T>>
+class IntrusiveList
+{
+private:
+  using Link = typename Hook::hook_type;
+
+  Link sentinel;
+  size_t size;
+
+  static T * objectOf(Link * link) { return Hook::toObject(link); }
+  static const T * objectOf(const Link * link) { return Hook::toObject(const_cast<Link *>(link)); }
 
-  Node * search_ptr(const T & data)
+  void linkBefore(Link * position, T & object)
   {
-    Node * x = root;
-    while (x && x->data != data) {
-      if (data < x->data)
-        x = x->left;
-      else
-        x = x->right;
-    }
-    return x;
+    Link * link = Hook::toHook(&object);
+    if (link->is_linked()) throw std::invalid_argument("Object is already in a list");
+    link->next = position;
+    link->prev = position->prev;
+    position->prev->next = link;
+    position->prev = link;
+    ++size;
   }
 
-  void destroyRecursive(Node * node_ptr)
+  static void unlink(Link * link)
   {
-    if (node_ptr->left) destroyRecursive(node_ptr->left);
-    if (node_ptr->right) destroyRecursive(node_ptr->right);
-    delete node_ptr;
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = link->prev = nullptr;
   }
 
-  void left_rotate(Node * x)
+  void stealFrom(IntrusiveList & other) noexcept
   {
-    if (!x || !x->right) return;  // Cannot rotate if x or its right child is null
-
-    Node * y = x->right;  // Set y as the right child of x
+    if (other.empty()) return;
+    sentinel.next = other.sentinel.next;
+    sentinel.prev = other.sentinel.prev;
+    sentinel.next->prev = sentinel.prev->next = &sentinel;
+    size = other.size;
+    other.sentinel.next = other.sentinel.prev = &other.sentinel;
+    other.size = 0;
+  }
 
-    // Turn y's left subtree into x's right subtree
-    x->right = y->left;
-    if (y->left) y->left->parent = x;
-
-    // Link x's parent to y
-    y->parent = x->parent;
-    if (!x->parent)  // x was root
-      root = y;
-    else if (x == x->parent->left)  // x was left child
-      x->parent->left = y;
-    else  // x was right child
-      x->parent->right = y;
+public:
+  class iterator;
+  class const_iterator;
+  class reverse_iterator;
+  class const_reverse_iterator;
 
-    // Put x on y's left
-    y->left = x;
-    x->parent = y;
-  }
+  IntrusiveList() : size(0) { sentinel.next = sentinel.prev = &sentinel; }
 
-  void right_rotate(Node * y)
-  {
-    if (!y || !y->left) return;  // Cannot rotate if y or its left child is null
+  IntrusiveList(const IntrusiveList &) = delete;
+  IntrusiveList & operator=(const IntrusiveList &) = delete;
 
-    Node * x = y->left;  // Set x as the left child of y
+  IntrusiveList(IntrusiveList && other) noexcept : IntrusiveList() { stealFrom(other); }
 
-    // Turn x's right subtree into y's left subtree
-    y->left = x->right;
-    if (x->right) x->right->parent = y;
+  IntrusiveList & operator=(IntrusiveList && other) noexcept
+  {
+    if (this == &other) return *this;
+    clear();
+    stealFrom(other);
+    return *this;
+  }
 
-    // Link y's parent to x
-    x->parent = y->parent;
-    if (!y->parent)  // y was root
-      root = x;
-    else if (y == y->parent->left)  // y was left child
-      y->parent->left = x;
-    else  // y was right child
-      y->parent->right = x;
+  // Unlinks the elements; the objects themselves are left alone
+  ~IntrusiveList() { clear(); }
 
-    // Put y on x's right
-    x->right = y;
-    y->parent = x;
+  void clear() noexcept
+  {
+    Link * current = sentinel.next;
+    while (current != &sentinel) {
+      Link * next = current->next;
+      current->next = current->prev = nullptr;
+      current = next;
+    }
+    sentinel.next = sentinel.prev = &sentinel;
+    size = 0;
   }
 
-public:
-  class iterator;
-  class const_iterator;
+  void push_back(T & object) { linkBefore(&sentinel, object); }
+  void push_front(T & object) { linkBefore(sentinel.next, object); }
 
-  BST() : root(nullptr), size(0) {}
-  ~BST()
+  // Links object in front of position and returns an iterator to it
+  iterator insert(iterator position, T & object)
   {
-    if (root) destroyRecursive(root);
+    linkBefore(position.current, object);
+    return iterator(Hook::toHook(&object));
   }
 
-  size_t getSize() { return size; }
-  bool empty() { return !size; }
-
-  void deleteNode(const T & data)
+  void pop_back()
   {
-    Node * z = search_ptr(data);
-    if (!z) return;
-    if (!(z->left))
-      transplant(z, z->right);
-    else if (!(z->right))
-      transplant(z, z->left);
-    else {
-      Node * y = getMinimumPtr(z->right);
-      if (y->parent != z) {
-        transplant(y, y->right);
-        y->right = z->right;
-        y->right->parent = y;
-      }
-      transplant(z, y);
-      y->left = z->left;
-      y->left->parent = y;
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
     }
-    delete z;
+    unlink(sentinel.prev);
     --size;
   }
 
-  void insert(const T & data)
+  void pop_front()
   {
-    Node * z = new Node(data);
-    Node * x = root;
-    Node * y = nullptr;
-    while (x) {
-      y = x;
-      if (data < x->data)
-        x = x->left;
-      else
-        x = x->right;
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
     }
-    z->parent = y;
-    if (!y)
-      root = z;
-    else if (data < y->data)
-      y->left = z;
-    else
-      y->right = z;
-    ++size;
+    unlink(sentinel.next);
+    --size;
   }
 
-  bool search(const T & data) { return search_ptr(data); }
-
-  T getMinimum()
+  // Unlinks object, which must be in this list, and returns an iterator to its successor
+  iterator erase(T & object)
   {
-    if (empty()) throw out_of_range("Can't find minimum when empty.");
-    return getMinimumPtr(root)->data;
+    Link * link = Hook::toHook(&object);
+    if (!link->is_linked()) throw std::invalid_argument("Object is not in a list");
+    Link * next = link->next;
+    unlink(link);
+    --size;
+    return iterator(next);
   }
 
-  T getMaximum()
+  iterator erase(iterator position) { return erase(*position); }
+
+  T & front()
   {
-    if (empty()) throw out_of_range("Can't find maximum when empty.");
-    return getMaximumPtr(root)->data;
+    if (empty()) {
+      throw out_of_range("Can't access front of empty list");
+    }
+    return *objectOf(sentinel.next);
   }
 
-  bool left_rotate(const T & data)
+  T & back()
   {
-    Node * node = search_ptr(data);
-    if (!node || !node->right) return false;  // Node must exist and have a right child
-
-    left_rotate(node);
-    return true;
+    if (empty()) {
+      throw out_of_range("Can't access back of empty list");
+    }
+    return *objectOf(sentinel.prev);
   }
 
-  bool right_rotate(const T & data)
-  {
-    Node * node = search_ptr(data);
-    if (!node || !node->left) return false;  // Node must exist and have a left child
+  bool empty() const noexcept { return size == 0; }
+  size_t getSize() const noexcept { return size; }
 
-    right_rotate(node);
-    return true;
-  }
+  // Iterator to an object already in this list, found in O(1)
+  iterator iterator_to(T & object) { return iterator(Hook::toHook(&object)); }
 
-  iterator begin() { return iterator(getMinimumPtr(root)); }
-  iterator end() { return iterator(nullptr); }
-  const_iterator cbegin() const { return const_iterator(getMinimumPtr(root)); }
-  const_iterator cend() const { return const_iterator(nullptr); }
+  iterator begin() { return iterator(sentinel.next); }
+  iterator end() { return iterator(&sentinel); }
+  const_iterator cbegin() const { return const_iterator(sentinel.next); }
+  const_iterator cend() const { return const_iterator(&sentinel); }
+
+  reverse_iterator rbegin() { return reverse_iterator(sentinel.prev); }
+  reverse_iterator rend() { return reverse_iterator(&sentinel); }
+  const_reverse_iterator crbegin() const { return const_reverse_iterator(sentinel.prev); }
+  const_reverse_iterator crend() const { return const_reverse_iterator(&sentinel); }
 
   class iterator
   {
   private:
-    Node * current;
-    explicit iterator(Node * node) : current(node) {}
-    friend class BST;
-
-    Node * getSuccessor(Node * x)
-    {
-      if (x->right) {
-        Node * temp = x->right;
-        while (temp->left) temp = temp->left;
-        return temp;
-      }
-      Node * y = x->parent;
-      while (y && x == y->right) {
-        x = y;
-        y = y->parent;
-      }
-      return y;
-    }
-
-    Node * getPredecessor(Node * x)
-    {
-      if (x->left) {
-        Node * temp = x->left;
-        while (temp->right) temp = temp->right;
-        return temp;
-      }
-      Node * y = x->parent;
-      while (y && x == y->left) {
-        x = y;
-        y = y->parent;
-      }
-      return y;
-    }
+    Link * current;
+    explicit iterator(Link * link) : current(link) {}
+    friend class IntrusiveList;
 
   public:
-    T & operator*() { return current->data; }
+    T & operator*() { return *objectOf(current); }
+    T * operator->() { return objectOf(current); }
     iterator & operator++()
     {
-      current = getSuccessor(current);
+      current = current->next;
       return *this;
     }
     iterator operator++(int)
     {
       iterator temp = *this;
-      current = getSuccessor(current);
+      current = current->next;
       return temp;
     }
     iterator & operator--()
     {
-      current = getPredecessor(current);
+      current = current->prev;
       return *this;
     }
     iterator operator--(int)
     {
       iterator temp = *this;
-      current = getPredecessor(current);
+      current = current->prev;
       return temp;
     }
     bool operator==(const iterator & other) const { return current == other.current; }
@@ -518,69 +1506,5064 @@ public:
   class const_iterator
   {
   private:
-    const Node * current;
-    explicit const_iterator(const Node * node) : current(node) {}
-    friend class BST;
-
-    Node * getSuccessor(Node * x) const
-    {
-      if (x->right) {
-        Node * temp = x->right;
-        while (temp->left) temp = temp->left;
-        return temp;
-      }
-      Node * y = x->parent;
-      while (y && x == y->right) {
-        x = y;
-        y = y->parent;
-      }
-      return y;
-    }
-
-    Node * getPredecessor(Node * x) const
-    {
-      if (x->left) {
-        Node * temp = x->left;
-        while (temp->right) temp = temp->right;
-        return temp;
-      }
-      Node * y = x->parent;
-      while (y && x == y->left) {
-        x = y;
-        y = y->parent;
-      }
-      return y;
-    }
+    const Link * current;
+    explicit const_iterator(const Link * link) : current(link) {}
+    friend class IntrusiveList;
 
   public:
-    const T & operator*() const { return current->data; }
+    const T & operator*() const { return *objectOf(current); }
+    const T * operator->() const { return objectOf(current); }
     const_iterator & operator++()
     {
-      current = getSuccessor(const_cast<Node *>(current));
+      current = current->next;
       return *this;
     }
     const_iterator operator++(int)
     {
       const_iterator temp = *this;
-      current = getSuccessor(const_cast<Node *>(current));
+      current = current->next;
       return temp;
     }
     const_iterator & operator--()
     {
-      current = getPredecessor(const_cast<Node *>(current));
+      current = current->prev;
       return *this;
     }
     const_iterator operator--(int)
     {
       const_iterator temp = *this;
-      current = getPredecessor(const_cast<Node *>(current));
+      current = current->prev;
       return temp;
     }
     bool operator==(const const_iterator & other) const { return current == other.current; }
     bool operator!=(const const_iterator & other) const { return current != other.current; }
   };
+
+  class reverse_iterator
+  {
+  private:
+    Link * current;
+    explicit reverse_iterator(Link * link) : current(link) {}
+    friend class IntrusiveList;
+
+  public:
+    T & operator*() { return *objectOf(current); }
+    T * operator->() { return objectOf(current); }
+    reverse_iterator & operator++()
+    {
+      current = current->prev;
+      return *this;
+    }
+    reverse_iterator operator++(int)
+    {
+      reverse_iterator temp = *this;
+      current = current->prev;
+      return temp;
+    }
+    reverse_iterator & operator--()
+    {
+      current = current->next;
+      return *this;
+    }
+    reverse_iterator operator--(int)
+    {
+      reverse_iterator temp = *this;
+      current = current->next;
+      return temp;
+    }
+    bool operator==(const reverse_iterator & other) const { return current == other.current; }
+    bool operator!=(const reverse_iterator & other) const { return current != other.current; }
+  };
+
+  class const_reverse_iterator
+  {
+  private:
+    const Link * current;
+    explicit const_reverse_iterator(const Link * link) : current(link) {}
+    friend class IntrusiveList;
+
+  public:
+    const T & operator*() const { return *objectOf(current); }
+    const T * operator->() const { return objectOf(current); }
+    const_reverse_iterator & operator++()
+    {
+      current = current->prev;
+      return *this;
+    }
+    const_reverse_iterator operator++(int)
+    {
+      const_reverse_iterator temp = *this;
+      current = current->prev;
+      return temp;
+    }
+    const_reverse_iterator & operator--()
+    {
+      current = current->next;
+      return *this;
+    }
+    const_reverse_iterator operator--(int)
+    {
+      const_reverse_iterator temp = *this;
+      current = current->next;
+      return temp;
+    }
+    bool operator==(const const_reverse_iterator & other) const { return current == other.current; }
+    bool operator!=(const const_reverse_iterator & other) const { return current != other.current; }
+  };
 };
 
+// Unrolled variant of LinkedList: every node holds a small array of elements instead of a
+// single one, so a traversal walks contiguous memory and the two link pointers are paid once
+// per node rather than once per element. The per-node capacity is picked from sizeof(T) so
+// that a node spans roughly four cache lines.
+template <typename T, typename Allocator = std::allocator<T>>
+class UnrolledLinkedList
+{
+public:
+  static constexpr size_t node_bytes = 256;
+  static constexpr size_t capacity =
+    (node_bytes - 2 * sizeof(void *) - 2 * sizeof(std::uint16_t)) / sizeof(T) < 4
+      ? 4
+      : (node_bytes - 2 * sizeof(void *) - 2 * sizeof(std::uint16_t)) / sizeof(T);
+  static_assert(capacity <= UINT16_MAX, "node capacity must fit in 16 bits");
+
+private:
+  // Live elements occupy slots [first, last). Nodes filled by push_back grow towards the
+  // end of the array and nodes filled by push_front grow towards the start.
+  struct Node
+  {
+    Node * next;
+    Node * prev;
+    std::uint16_t first;
+    std::uint16_t last;
+    alignas(T) unsigned char storage[sizeof(T) * capacity];
+
+    Node(std::uint16_t position) : next(nullptr), prev(nullptr), first(position), last(position)
+    {
+    }
+
+    T * slot(size_t i) { return std::launder(reinterpret_cast<T *>(storage) + i); }
+    const T * slot(size_t i) const
+    {
+      return std::launder(reinterpret_cast<const T *>(storage) + i);
+    }
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+  Node * head;
+  Node * tail;
+  size_t size;
+  NodeAllocator alloc;
+
+  Node * createNode(std::uint16_t position)
+  {
+    Node * node = NodeTraits::allocate(alloc, 1);
+    NodeTraits::construct(alloc, node, position);
+    return node;
+  }
+
+  void destroyNode(Node * node)
+  {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
+  }
+
+  void unlinkNode(Node * node)
+  {
+    if (node->prev)
+      node->prev->next = node->next;
+    else
+      head = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+    else
+      tail = node->prev;
+    destroyNode(node);
+  }
+
+  void stealFrom(UnrolledLinkedList & other) noexcept
+  {
+    head = other.head;
+    tail = other.tail;
+    size = other.size;
+    other.head = other.tail = nullptr;
+    other.size = 0;
+  }
+
+  template <typename NodePtr>
+  static void advance(NodePtr & node, size_t & index)
+  {
+    if (++index == node->last) {
+      node = node->next;
+      index = node ? node->first : 0;
+    }
+  }
+
+  template <typename NodePtr>
+  static void retreat(NodePtr & node, size_t & index)
+  {
+    if (index == node->first) {
+      node = node->prev;
+      index = node ? node->last - 1 : 0;
+    } else {
+      --index;
+    }
+  }
+
+public:
+  class iterator;
+  class const_iterator;
+  class reverse_iterator;
+  class const_reverse_iterator;
+
+  using allocator_type = Allocator;
+
+  UnrolledLinkedList() : UnrolledLinkedList(Allocator()) {}
+  explicit UnrolledLinkedList(const Allocator & allocator)
+      : head(nullptr), tail(nullptr), size(0), alloc(allocator)
+  {
+  }
+
+  UnrolledLinkedList(const UnrolledLinkedList & other)
+      : UnrolledLinkedList(
+          Allocator(NodeTraits::select_on_container_copy_construction(other.alloc)))
+  {
+    for (auto it = other.cbegin(); it != other.cend(); ++it) push_back(*it);
+  }
+
+  UnrolledLinkedList(UnrolledLinkedList && other) noexcept
+      : head(nullptr), tail(nullptr), size(0), alloc(std::move(other.alloc))
+  {
+    stealFrom(other);
+  }
+
+  UnrolledLinkedList & operator=(const UnrolledLinkedList & other)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) alloc = other.alloc;
+    for (auto it = other.cbegin(); it != other.cend(); ++it) push_back(*it);
+    return *this;
+  }
+
+  UnrolledLinkedList & operator=(UnrolledLinkedList && other) noexcept(
+    NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+      alloc = std::move(other.alloc);
+      stealFrom(other);
+    } else {
+      if (alloc == other.alloc) {
+        stealFrom(other);
+      } else {
+        for (auto it = other.begin(); it != other.end(); ++it) push_back(std::move(*it));
+        other.clear();
+      }
+    }
+    return *this;
+  }
+
+  ~UnrolledLinkedList() { clear(); }
+
+  allocator_type get_allocator() const { return allocator_type(alloc); }
+
+  void clear() noexcept
+  {
+    Node * current = head;
+    while (current) {
+      Node * next = current->next;
+      for (size_t i = current->first; i < current->last; ++i)
+        NodeTraits::destroy(alloc, current->slot(i));
+      destroyNode(current);
+      current = next;
+    }
+    head = tail = nullptr;
+    size = 0;
+  }
+
+  template <typename... Args>
+  T & emplace_back(Args &&... args)
+  {
+    if (!tail || tail->last == capacity) {
+      Node * newNode = createNode(0);
+      if (tail) {
+        newNode->prev = tail;
+        tail->next = newNode;
+      } else {
+        head = newNode;
+      }
+      tail = newNode;
+    }
+    T * slot = tail->slot(tail->last);
+    try {
+      NodeTraits::construct(alloc, slot, std::forward<Args>(args)...);
+    } catch (...) {
+      if (tail->first == tail->last) unlinkNode(tail);
+      throw;
+    }
+    ++tail->last;
+    ++size;
+    return *slot;
+  }
+
+  template <typename... Args>
+  T & emplace_front(Args &&... args)
+  {
+    if (!head || head->first == 0) {
+      Node * newNode = createNode(capacity);
+      if (head) {
+        newNode->next = head;
+        head->prev = newNode;
+      } else {
+        tail = newNode;
+      }
+      head = newNode;
+    }
+    T * slot = head->slot(head->first - 1);
+    try {
+      NodeTraits::construct(alloc, slot, std::forward<Args>(args)...);
+    } catch (...) {
+      if (head->first == head->last) unlinkNode(head);
+      throw;
+    }
+    --head->first;
+    ++size;
+    return *slot;
+  }
+
+  void push_back(const T & value) { emplace_back(value); }
+  void push_back(T && value) { emplace_back(std::move(value)); }
+  void push_front(const T & value) { emplace_front(value); }
+  void push_front(T && value) { emplace_front(std::move(value)); }
+
+  void pop_back()
+  {
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
+    }
+    NodeTraits::destroy(alloc, tail->slot(--tail->last));
+    if (tail->first == tail->last) unlinkNode(tail);
+    --size;
+  }
+
+  void pop_front()
+  {
+    if (empty()) {
+      throw out_of_range("Cannot pop from empty list");
+    }
+    NodeTraits::destroy(alloc, head->slot(head->first++));
+    if (head->first == head->last) unlinkNode(head);
+    --size;
+  }
+
+  bool empty() const noexcept { return size == 0; }
+  size_t getSize() const noexcept { return size; }
+
+  iterator begin() { return iterator(head, head ? head->first : 0); }
+  iterator end() { return iterator(nullptr, 0); }
+  const_iterator cbegin() const { return const_iterator(head, head ? head->first : 0); }
+  const_iterator cend() const { return const_iterator(nullptr, 0); }
+
+  reverse_iterator rbegin() { return reverse_iterator(tail, tail ? tail->last - 1 : 0); }
+  reverse_iterator rend() { return reverse_iterator(nullptr, 0); }
+  const_reverse_iterator crbegin() const
+  {
+    return const_reverse_iterator(tail, tail ? tail->last - 1 : 0);
+  }
+  const_reverse_iterator crend() const { return const_reverse_iterator(nullptr, 0); }
+
+  class iterator
+  {
+  private:
+    Node * current;
+    size_t index;
+    iterator(Node * node, size_t i) : current(node), index(i) {}
+    friend class UnrolledLinkedList;
+
+  public:
+    T & operator*() { return *current->slot(index); }
+    iterator & operator++()
+    {
+      advance(current, index);
+      return *this;
+    }
+    iterator operator++(int)
+    {
+      iterator temp = *this;
+      advance(current, index);
+      return temp;
+    }
+    iterator & operator--()
+    {
+      retreat(current, index);
+      return *this;
+    }
+    iterator operator--(int)
+    {
+      iterator temp = *this;
+      retreat(current, index);
+      return temp;
+    }
+    bool operator==(const iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const iterator & other) const { return !(*this == other); }
+  };
+
+  class const_iterator
+  {
+  private:
+    const Node * current;
+    size_t index;
+    const_iterator(const Node * node, size_t i) : current(node), index(i) {}
+    friend class UnrolledLinkedList;
+
+  public:
+    const T & operator*() const { return *current->slot(index); }
+    const_iterator & operator++()
+    {
+      advance(current, index);
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      advance(current, index);
+      return temp;
+    }
+    const_iterator & operator--()
+    {
+      retreat(current, index);
+      return *this;
+    }
+    const_iterator operator--(int)
+    {
+      const_iterator temp = *this;
+      retreat(current, index);
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const const_iterator & other) const { return !(*this == other); }
+  };
+
+  class reverse_iterator
+  {
+  private:
+    Node * current;
+    size_t index;
+    reverse_iterator(Node * node, size_t i) : current(node), index(i) {}
+    friend class UnrolledLinkedList;
+
+  public:
+    T & operator*() { return *current->slot(index); }
+    reverse_iterator & operator++()
+    {
+      retreat(current, index);
+      return *this;
+    }
+    reverse_iterator operator++(int)
+    {
+      reverse_iterator temp = *this;
+      retreat(current, index);
+      return temp;
+    }
+    reverse_iterator & operator--()
+    {
+      advance(current, index);
+      return *this;
+    }
+    reverse_iterator operator--(int)
+    {
+      reverse_iterator temp = *this;
+      advance(current, index);
+      return temp;
+    }
+    bool operator==(const reverse_iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const reverse_iterator & other) const { return !(*this == other); }
+  };
+
+  class const_reverse_iterator
+  {
+  private:
+    const Node * current;
+    size_t index;
+    const_reverse_iterator(const Node * node, size_t i) : current(node), index(i) {}
+    friend class UnrolledLinkedList;
+
+  public:
+    const T & operator*() const { return *current->slot(index); }
+    const_reverse_iterator & operator++()
+    {
+      retreat(current, index);
+      return *this;
+    }
+    const_reverse_iterator operator++(int)
+    {
+      const_reverse_iterator temp = *this;
+      retreat(current, index);
+      return temp;
+    }
+    const_reverse_iterator & operator--()
+    {
+      advance(current, index);
+      return *this;
+    }
+    const_reverse_iterator operator--(int)
+    {
+      const_reverse_iterator temp = *this;
+      advance(current, index);
+      return temp;
+    }
+    bool operator==(const const_reverse_iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const const_reverse_iterator & other) const { return !(*this == other); }
+  };
+};
+
+// Epoch-based memory reclamation shared by the lock-free containers. Readers bracket every
+// access to shared nodes with an EpochGuard; writers hand unlinked nodes to retire() instead
+// of deleting them. A node retired during global epoch e is freed once the epoch reaches
+// e + 2, at which point every thread that could still have been looking at it has left its
+// critical section.
+class EpochReclaimer
+{
+private:
+  struct Retired
+  {
+    void * ptr;
+    void (*deleter)(void *);
+    std::uint64_t epoch;
+  };
+
+  // One record per thread; records are claimed by threads and recycled after they exit,
+  // but never unlinked, so the list can be walked without synchronisation.
+  struct ThreadRecord
+  {
+    std::atomic<std::uint64_t> state;  // (local epoch << 1) | active
+    std::atomic<bool> in_use;
+    ThreadRecord * next;
+    unsigned nesting;
+    size_t retires_since_scan;
+    std::vector<Retired> retired;
+
+    ThreadRecord() : state(0), in_use(true), next(nullptr), nesting(0), retires_since_scan(0) {}
+  };
+
+  struct ThreadHandle
+  {
+    EpochReclaimer * owner = nullptr;
+    ThreadRecord * record = nullptr;
+
+    ~ThreadHandle()
+    {
+      if (record) owner->releaseRecord(record);
+    }
+  };
+
+  static constexpr size_t scan_threshold = 64;
+
+  std::atomic<std::uint64_t> global_epoch;
+  std::atomic<ThreadRecord *> records;
+
+  ThreadRecord * acquireRecord()
+  {
+    for (ThreadRecord * r = records.load(); r; r = r->next) {
+      bool expected = false;
+      if (!r->in_use.load() && r->in_use.compare_exchange_strong(expected, true)) return r;
+    }
+    ThreadRecord * r = new ThreadRecord();
+    ThreadRecord * head = records.load();
+    do {
+      r->next = head;
+    } while (!records.compare_exchange_weak(head, r));
+    return r;
+  }
+
+  void releaseRecord(ThreadRecord * r)
+  {
+    collect(r);
+    r->in_use.store(false);
+  }
+
+  ThreadRecord * localRecord()
+  {
+    thread_local ThreadHandle handle;
+    if (!handle.record) {
+      handle.owner = this;
+      handle.record = acquireRecord();
+    }
+    return handle.record;
+  }
+
+  // Moves the global epoch forward if every active thread has caught up with it.
+  void tryAdvance()
+  {
+    std::uint64_t epoch = global_epoch.load();
+    for (ThreadRecord * r = records.load(); r; r = r->next) {
+      std::uint64_t s = r->state.load();
+      if ((s & 1) && (s >> 1) != epoch) return;
+    }
+    global_epoch.compare_exchange_strong(epoch, epoch + 1);
+  }
+
+  void collect(ThreadRecord * r)
+  {
+    std::uint64_t epoch = global_epoch.load();
+    size_t freed = 0;
+    // Retired entries are appended in epoch order, so the reclaimable ones form a prefix
+    while (freed < r->retired.size() && r->retired[freed].epoch + 2 <= epoch) {
+      r->retired[freed].deleter(r->retired[freed].ptr);
+      ++freed;
+    }
+    r->retired.erase(r->retired.begin(), r->retired.begin() + freed);
+  }
+
+  EpochReclaimer() : global_epoch(0), records(nullptr) {}
+
+public:
+  EpochReclaimer(const EpochReclaimer &) = delete;
+  EpochReclaimer & operator=(const EpochReclaimer &) = delete;
+
+  ~EpochReclaimer()
+  {
+    ThreadRecord * r = records.load();
+    while (r) {
+      for (Retired & item : r->retired) item.deleter(item.ptr);
+      ThreadRecord * next = r->next;
+      delete r;
+      r = next;
+    }
+  }
+
+  static EpochReclaimer & instance()
+  {
+    static EpochReclaimer reclaimer;
+    return reclaimer;
+  }
+
+  void enter()
+  {
+    ThreadRecord * r = localRecord();
+    if (r->nesting++ == 0) r->state.store((global_epoch.load() << 1) | 1);
+  }
+
+  void exit()
+  {
+    ThreadRecord * r = localRecord();
+    if (--r->nesting == 0) r->state.store(r->state.load() & ~std::uint64_t(1));
+  }
+
+  // Schedules ptr for deletion once no thread can still hold a reference to it. ptr must
+  // already be unreachable for threads that enter after this call.
+  void retire(void * ptr, void (*deleter)(void *))
+  {
+    ThreadRecord * r = localRecord();
+    r->retired.push_back({ptr, deleter, global_epoch.load()});
+    if (++r->retires_since_scan >= scan_threshold) {
+      r->retires_since_scan = 0;
+      tryAdvance();
+      collect(r);
+    }
+  }
+};
+
+class EpochGuard
+{
+public:
+  EpochGuard() { EpochReclaimer::instance().enter(); }
+  ~EpochGuard() { EpochReclaimer::instance().exit(); }
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard & operator=(const EpochGuard &) = delete;
+};
+
+// Lock-free multi-producer/multi-consumer FIFO queue (Michael & Scott). The queue always
+// holds a dummy node at head; a value lives in the node after the one head points to.
+// Only the consumer whose CAS on head succeeds touches that value, and nodes are reclaimed
+// through EpochReclaimer, so no ABA or use-after-free is possible.
+template <typename T>
+class ConcurrentQueue
+{
+private:
+  struct Node
+  {
+    std::atomic<Node *> next;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    Node() : next(nullptr) {}
+
+    T * value() { return std::launder(reinterpret_cast<T *>(storage)); }
+  };
+
+  // head and tail are written by different sides of the queue; keep them on separate lines
+  alignas(64) std::atomic<Node *> head;
+  alignas(64) std::atomic<Node *> tail;
+
+  static void deleteNode(void * p) { delete static_cast<Node *>(p); }
+
+  void linkNode(Node * node)
+  {
+    EpochGuard guard;
+    while (true) {
+      Node * last = tail.load();
+      Node * next = last->next.load();
+      if (last != tail.load()) continue;
+      if (next) {
+        // tail is lagging behind; help the other producer finish
+        tail.compare_exchange_weak(last, next);
+        continue;
+      }
+      if (last->next.compare_exchange_weak(next, node)) {
+        tail.compare_exchange_strong(last, node);
+        return;
+      }
+    }
+  }
+
+public:
+  ConcurrentQueue()
+  {
+    Node * dummy = new Node();
+    head.store(dummy);
+    tail.store(dummy);
+  }
+
+  ConcurrentQueue(const ConcurrentQueue &) = delete;
+  ConcurrentQueue & operator=(const ConcurrentQueue &) = delete;
+
+  // Not safe to run concurrently with any other operation on the queue
+  ~ConcurrentQueue()
+  {
+    Node * current = head.load();
+    Node * next = current->next.load();
+    delete current;  // dummy, holds no value
+    while (next) {
+      current = next;
+      next = current->next.load();
+      current->value()->~T();
+      delete current;
+    }
+  }
+
+  void push(const T & value) { emplace(value); }
+  void push(T && value) { emplace(std::move(value)); }
+
+  template <typename... Args>
+  void emplace(Args &&... args)
+  {
+    Node * node = new Node();
+    try {
+      ::new (node->storage) T(std::forward<Args>(args)...);
+    } catch (...) {
+      delete node;
+      throw;
+    }
+    linkNode(node);
+  }
+
+  // Moves the oldest element into out and returns true, or returns false if the queue was
+  // observed empty.
+  bool try_pop(T & out)
+  {
+    EpochGuard guard;
+    while (true) {
+      Node * first = head.load();
+      Node * last = tail.load();
+      Node * next = first->next.load();
+      if (first != head.load()) continue;
+      if (!next) return false;
+      if (first == last) {
+        tail.compare_exchange_weak(last, next);
+        continue;
+      }
+      if (head.compare_exchange_weak(first, next)) {
+        // next is the new dummy; its value now belongs to this thread alone. The old dummy
+        // is retired first, so that neither it nor the value leaks if moving the value into
+        // out throws; the element is then lost, as it has already left the queue.
+        T * value = next->value();
+        EpochReclaimer::instance().retire(first, &deleteNode);
+        try {
+          out = std::move(*value);
+        } catch (...) {
+          value->~T();
+          throw;
+        }
+        value->~T();
+        return true;
+      }
+    }
+  }
+
+  // Snapshot answer; may be stale by the time the caller looks at it
+  bool empty() const
+  {
+    EpochGuard guard;
+    return !head.load()->next.load();
+  }
+};
+
+// Lock-free ordered set (a skip list in the style of Herlihy and Shavit). Every node sits on
+// level 0 and on each level above up to its random height, with about half the nodes of one
+// level reaching the next. Links are CAS-ed, and the low bit of a link word marks the node
+// holding it as deleted on that level: erase marks a node's levels top-down, the mark on
+// level 0 is the moment it leaves the set, and traversals then snip it out. contains and
+// lower_bound never write. Unlinked nodes are retired through EpochReclaimer, and every
+// operation runs inside an EpochGuard. Values are compared with Compare; values that are
+// equivalent under it count as equal, and the set holds at most one of them.
+template <typename T, typename Compare = std::less<T>>
+class ConcurrentSkipList
+{
+private:
+  static constexpr int max_height = 32;
+
+  struct Node
+  {
+    // Two owners: the inserting thread until it has finished linking the upper levels, and
+    // the set until the node is erased. Whoever lets go last retires the node.
+    std::atomic<int> owners;
+    int height;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    const T & value() const { return *std::launder(reinterpret_cast<const T *>(storage)); }
+
+    // height link words follow the node in the same allocation
+    std::atomic<uintptr_t> * links()
+    {
+      return reinterpret_cast<std::atomic<uintptr_t> *>(reinterpret_cast<unsigned char *>(this) +
+                                                        links_offset);
+    }
+  };
+
+  static constexpr size_t links_offset =
+    (sizeof(Node) + alignof(std::atomic<uintptr_t>) - 1) & ~(alignof(std::atomic<uintptr_t>) - 1);
+
+  Node * head;  // no value; max_height links
+  std::atomic<size_t> count;
+  // Highest level any node has reached; searches start there rather than at max_height.
+  // Levels above it are empty, so a stale value only costs a few extra steps.
+  std::atomic<int> levels;
+  Compare less;
+
+  static Node * pointer(uintptr_t word) { return reinterpret_cast<Node *>(word & ~uintptr_t(1)); }
+  static bool marked(uintptr_t word) { return word & 1; }
+  static uintptr_t wordOf(Node * node) { return reinterpret_cast<uintptr_t>(node); }
+
+  static Node * allocateNode(int height)
+  {
+    void * raw = ::operator new(links_offset + height * sizeof(std::atomic<uintptr_t>),
+                                std::align_val_t(alignof(Node)));
+    Node * node = ::new (raw) Node;
+    node->owners.store(2, std::memory_order_relaxed);
+    node->height = height;
+    for (int i = 0; i < height; ++i) ::new (node->links() + i) std::atomic<uintptr_t>(0);
+    return node;
+  }
+
+  static void freeNode(Node * node)
+  {
+    node->~Node();
+    ::operator delete(node, std::align_val_t(alignof(Node)));
+  }
+
+  static void destroyNode(void * p)
+  {
+    Node * node = static_cast<Node *>(p);
+    const_cast<T &>(node->value()).~T();
+    freeNode(node);
+  }
+
+  template <typename... Args>
+  static Node * createNode(Args &&... args)
+  {
+    Node * node = allocateNode(randomHeight());
+    try {
+      ::new (node->storage) T(std::forward<Args>(args)...);
+    } catch (...) {
+      freeNode(node);
+      throw;
+    }
+    return node;
+  }
+
+  // Geometric height: level i + 1 is reached with probability 2^-i
+  static int randomHeight()
+  {
+    thread_local std::uint64_t state =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return 1 + countTrailingZeros(state | (std::uint64_t(1) << (max_height - 1)));
+  }
+
+  void release(Node * node)
+  {
+    if (node->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      EpochReclaimer::instance().retire(node, &destroyNode);
+  }
+
+  // Fills preds and succs with the nodes around key on every level, snipping out marked
+  // nodes on the way, and reports whether succs[0] holds a value equal to key. With
+  // pastEqual set the walk also goes on through the values equal to key, so that a deleted
+  // node is unlinked even when an equal value was inserted in front of it.
+  bool find(const T & key, Node ** preds, Node ** succs, bool pastEqual = false)
+  {
+    // Only the levels below top are filled in. That covers every level of any node the
+    // caller can have seen: inserters raise levels before they link anything.
+    int top = levels.load(std::memory_order_relaxed);
+  retry:
+    Node * pred = head;
+    for (int level = top - 1; level >= 0; --level) {
+      Node * curr = pointer(pred->links()[level].load());
+      while (curr) {
+        uintptr_t succ = curr->links()[level].load();
+        if (marked(succ)) {
+          uintptr_t expected = wordOf(curr);
+          if (!pred->links()[level].compare_exchange_strong(expected, succ & ~uintptr_t(1)))
+            goto retry;
+          curr = pointer(succ);
+          continue;
+        }
+        bool advance = pastEqual ? !less(key, curr->value()) : less(curr->value(), key);
+        if (!advance) break;
+        pred = curr;
+        curr = pointer(succ);
+      }
+      preds[level] = pred;
+      succs[level] = curr;
+    }
+    return succs[0] && !less(key, succs[0]->value());
+  }
+
+  // First node on level 0 not less than key and not deleted, without modifying anything
+  Node * lowerBoundNode(const T & key) const
+  {
+    Node * pred = head;
+    Node * curr = nullptr;
+    for (int level = levels.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+      curr = pointer(pred->links()[level].load());
+      while (curr) {
+        uintptr_t succ = curr->links()[level].load();
+        if (!marked(succ) && !less(curr->value(), key)) break;
+        if (!marked(succ)) pred = curr;
+        curr = pointer(succ);
+      }
+    }
+    return curr;
+  }
+
+  static Node * firstLive(Node * node)
+  {
+    while (node && marked(node->links()[0].load())) node = pointer(node->links()[0].load());
+    return node;
+  }
+
+  bool insertNode(Node * node)
+  {
+    EpochGuard guard;
+    int top = levels.load(std::memory_order_relaxed);
+    while (top < node->height && !levels.compare_exchange_weak(top, node->height)) {
+    }
+    Node * preds[max_height];
+    Node * succs[max_height];
+    while (true) {
+      if (find(node->value(), preds, succs)) {
+        destroyNode(node);  // never published
+        return false;
+      }
+      for (int level = 0; level < node->height; ++level)
+        node->links()[level].store(wordOf(succs[level]), std::memory_order_relaxed);
+      uintptr_t expected = wordOf(succs[0]);
+      if (preds[0]->links()[0].compare_exchange_strong(expected, wordOf(node))) break;
+    }
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    // The value is in the set now; the upper levels only speed up searches. Linking stops
+    // early if the node gets erased meanwhile, which marks its links.
+    for (int level = 1; level < node->height; ++level) {
+      while (true) {
+        uintptr_t link = node->links()[level].load();
+        if (marked(link)) goto linked;
+        if (pointer(link) != succs[level] &&
+            !node->links()[level].compare_exchange_strong(link, wordOf(succs[level])))
+          goto linked;
+        uintptr_t expected = wordOf(succs[level]);
+        if (preds[level]->links()[level].compare_exchange_strong(expected, wordOf(node))) break;
+        find(node->value(), preds, succs);
+      }
+    }
+  linked:
+    // An erase that ran while the upper levels were being linked may have missed some of
+    // them; unlink the node fully before giving up ownership
+    if (marked(node->links()[0].load())) find(node->value(), preds, succs, true);
+    release(node);
+    return true;
+  }
+
+public:
+  class const_iterator;
+
+  explicit ConcurrentSkipList(const Compare & compare = Compare())
+      : count(0), levels(1), less(compare)
+  {
+    head = allocateNode(max_height);
+  }
+
+  ConcurrentSkipList(const ConcurrentSkipList &) = delete;
+  ConcurrentSkipList & operator=(const ConcurrentSkipList &) = delete;
+
+  // Not safe to run concurrently with any other operation on the set. Nodes still on
+  // level 0 have not been retired, so they are freed here.
+  ~ConcurrentSkipList()
+  {
+    Node * x = pointer(head->links()[0].load());
+    freeNode(head);
+    while (x) {
+      Node * next = pointer(x->links()[0].load());
+      destroyNode(x);
+      x = next;
+    }
+  }
+
+  // Adds value unless an equal one is present; returns whether it was added
+  bool insert(const T & value) { return insertNode(createNode(value)); }
+  bool insert(T && value) { return insertNode(createNode(std::move(value))); }
+
+  template <typename... Args>
+  bool emplace(Args &&... args)
+  {
+    return insertNode(createNode(std::forward<Args>(args)...));
+  }
+
+  // Removes the value equal to key, if any; returns whether this call removed it
+  bool erase(const T & key)
+  {
+    EpochGuard guard;
+    Node * preds[max_height];
+    Node * succs[max_height];
+    if (!find(key, preds, succs)) return false;
+    Node * victim = succs[0];
+    for (int level = victim->height - 1; level >= 1; --level) {
+      uintptr_t link = victim->links()[level].load();
+      while (!marked(link) && !victim->links()[level].compare_exchange_weak(link, link | 1)) {
+      }
+    }
+    uintptr_t link = victim->links()[0].load();
+    do {
+      if (marked(link)) return false;  // another thread erased it first
+    } while (!victim->links()[0].compare_exchange_weak(link, link | 1));
+    count.fetch_sub(1, std::memory_order_relaxed);
+    find(key, preds, succs, true);
+    release(victim);
+    return true;
+  }
+
+  bool contains(const T & key) const
+  {
+    EpochGuard guard;
+    Node * x = lowerBoundNode(key);
+    return x && !less(key, x->value());
+  }
+
+  // The BST names for contains and erase
+  bool search(const T & key) const { return contains(key); }
+  void deleteNode(const T & key) { erase(key); }
+
+  // Number of values, exact only while no other thread is inserting or erasing
+  size_t getSize() const { return count.load(std::memory_order_relaxed); }
+  bool empty() const { return getSize() == 0; }
+
+  // Iteration is weakly consistent: it sees the values in order, including every value that
+  // stays in the set throughout, and may or may not see values inserted or erased
+  // concurrently. An iterator keeps its thread inside an epoch for as long as it exists, so
+  // the nodes it can reach stay allocated; it must stay on the thread that created it, and
+  // holding one for long delays reclamation for every lock-free container.
+  const_iterator lower_bound(const T & key) const
+  {
+    const_iterator it(nullptr);
+    it.current = lowerBoundNode(key);
+    return it;
+  }
+
+  const_iterator begin() const
+  {
+    const_iterator it(nullptr);
+    it.current = firstLive(pointer(head->links()[0].load()));
+    return it;
+  }
+  const_iterator end() const { return const_iterator(nullptr); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  class const_iterator
+  {
+  private:
+    Node * current;
+    explicit const_iterator(Node * node) : current(node) { EpochReclaimer::instance().enter(); }
+    friend class ConcurrentSkipList;
+
+  public:
+    const_iterator(const const_iterator & other) : current(other.current)
+    {
+      EpochReclaimer::instance().enter();
+    }
+    const_iterator & operator=(const const_iterator & other)
+    {
+      current = other.current;
+      return *this;
+    }
+    ~const_iterator() { EpochReclaimer::instance().exit(); }
+
+    const T & operator*() const { return current->value(); }
+    const T * operator->() const { return &current->value(); }
+    const_iterator & operator++()
+    {
+      current = firstLive(pointer(current->links()[0].load()));
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      ++*this;
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const { return current == other.current; }
+    bool operator!=(const const_iterator & other) const { return current != other.current; }
+  };
+};
+
+// Immutable sorted set stored in Eytzinger (breadth-first) order: the children of slot k are
+// slots 2k and 2k + 1 (1-based), so the first levels of every search share a few cache
+// lines and the slots a search will touch next can be prefetched before they are needed.
+// Searches are branch-free: each level does one comparison that selects the child index.
+template <typename T, typename Compare = std::less<T>>
+class FrozenSet
+{
+private:
+  std::vector<T> keys;  // slot k lives at keys[k - 1]
+  Compare less;
+
+  // Number of keys per cache line; a search prefetches the line holding the descendants
+  // of the current slot this many levels down.
+  static constexpr size_t prefetch_stride = sizeof(T) >= 64 ? 1 : 64 / sizeof(T);
+
+  static size_t leftmost(size_t k, size_t n)
+  {
+    if (!k || !n) return 0;
+    while (2 * k <= n) k = 2 * k;
+    return k;
+  }
+
+  static size_t rightmost(size_t k, size_t n)
+  {
+    while (2 * k + 1 <= n) k = 2 * k + 1;
+    return k;
+  }
+
+  static size_t successor(size_t k, size_t n)
+  {
+    if (2 * k + 1 <= n) return leftmost(2 * k + 1, n);
+    while (k & 1) k >>= 1;  // climb while we are a right child
+    return k >> 1;
+  }
+
+  static size_t predecessor(size_t k, size_t n)
+  {
+    if (2 * k <= n) return rightmost(2 * k, n);
+    while (k > 1 && !(k & 1)) k >>= 1;  // climb while we are a left child
+    return k >> 1;
+  }
+
+  // Slot of the first key not less than x, or 0 if there is none
+  size_t lowerBoundSlot(const T & x) const
+  {
+    const T * base = keys.data();
+    size_t n = keys.size();
+    size_t k = 1;
+    while (k <= n) {
+      // May point past the end; prefetches never fault
+      std::uintptr_t ahead = reinterpret_cast<std::uintptr_t>(base + k - 1) +
+                             (k * (prefetch_stride - 1)) * sizeof(T);
+      prefetch(reinterpret_cast<const void *>(ahead));
+      k = 2 * k + less(base[k - 1], x);
+    }
+    // Undo the trailing right turns (and the final left turn) to get back to the answer
+    return k >> (countTrailingZeros(~static_cast<std::uint64_t>(k)) + 1);
+  }
+
+  // sorted holds the keys in ascending order; they are copied into Eytzinger order
+  FrozenSet(const std::vector<const T *> & sorted, const Compare & compare) : less(compare)
+  {
+    size_t n = sorted.size();
+    std::vector<size_t> rank(n);
+    size_t k = leftmost(1, n);
+    for (size_t i = 0; i < n; ++i) {
+      rank[k - 1] = i;
+      k = successor(k, n);
+    }
+    keys.reserve(n);
+    for (size_t slot = 0; slot < n; ++slot) keys.push_back(*sorted[rank[slot]]);
+  }
+
+  template <typename U, typename C, typename Allocator, bool Balanced, typename Stats>
+  friend class BST;
+
+public:
+  class const_iterator;
+
+  explicit FrozenSet(const Compare & compare = Compare()) : less(compare) {}
+
+  // Builds the set from any range, sorting a copy of it first if it is not already sorted
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  FrozenSet(InputIt first, InputIt last, const Compare & compare = Compare())
+  {
+    std::vector<T> values(first, last);
+    if (!std::is_sorted(values.begin(), values.end(), compare))
+      std::sort(values.begin(), values.end(), compare);
+    std::vector<const T *> sorted;
+    sorted.reserve(values.size());
+    for (const T & value : values) sorted.push_back(&value);
+    *this = FrozenSet(sorted, compare);
+  }
+
+  size_t getSize() const noexcept { return keys.size(); }
+  bool empty() const noexcept { return keys.empty(); }
+
+  bool search(const T & x) const
+  {
+    size_t k = lowerBoundSlot(x);
+    return k && !less(x, keys[k - 1]);
+  }
+
+  const_iterator lower_bound(const T & x) const { return const_iterator(this, lowerBoundSlot(x)); }
+
+  const_iterator begin() const { return const_iterator(this, leftmost(1, keys.size())); }
+  const_iterator end() const { return const_iterator(this, 0); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  class const_iterator
+  {
+  private:
+    const FrozenSet * set;
+    size_t slot;
+    const_iterator(const FrozenSet * s, size_t k) : set(s), slot(k) {}
+    friend class FrozenSet;
+
+  public:
+    const T & operator*() const { return set->keys[slot - 1]; }
+    const_iterator & operator++()
+    {
+      slot = successor(slot, set->keys.size());
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      slot = successor(slot, set->keys.size());
+      return temp;
+    }
+    const_iterator & operator--()
+    {
+      slot = predecessor(slot, set->keys.size());
+      return *this;
+    }
+    const_iterator operator--(int)
+    {
+      const_iterator temp = *this;
+      slot = predecessor(slot, set->keys.size());
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const { return slot == other.slot; }
+    bool operator!=(const const_iterator & other) const { return slot != other.slot; }
+  };
+};
+
+// Recognizes std::basic_string, whose compare() lets BST order strings in one pass
+template <typename T>
+struct IsBasicString : std::false_type
+{
+};
+template <typename CharT, typename Traits, typename A>
+struct IsBasicString<std::basic_string<CharT, Traits, A>> : std::true_type
+{
+  using view = std::basic_string_view<CharT, Traits>;
+};
+
+// How the search trees step down from a node when looking up key among values of type T.
+// Where a three-way answer costs one comparison, the walk orders key against each node and
+// stops at a match: strings under std::less through compare(), which settles less, equal
+// and greater in one pass over the characters, and arithmetic values under std::less or
+// std::greater by asking Compare both ways, which the compiler folds into one compare
+// instruction and a conditional move. Any other Compare is asked once per level down to
+// the lower bound of key and once more whether that bound is equivalent to key, about half
+// the calls of asking both ways at every node.
+template <typename T, typename Compare>
+struct ThreeWayOrder
+{
+  template <typename K>
+  static constexpr bool applies()
+  {
+    constexpr bool natural = std::is_same_v<Compare, std::less<T>> ||
+                             std::is_same_v<Compare, std::less<>>;
+    if constexpr (IsBasicString<T>::value)
+      return natural && std::is_convertible_v<const K &, typename IsBasicString<T>::view>;
+    else
+      return std::is_arithmetic_v<T> && std::is_arithmetic_v<K> &&
+             (natural || std::is_same_v<Compare, std::greater<T>> ||
+              std::is_same_v<Compare, std::greater<>>);
+  }
+
+  // Sets below and above to whether key orders before or after value; counts as one
+  // comparison
+  template <typename K>
+  static void order(const Compare & less, const K & key, const T & value, bool & below,
+                    bool & above)
+  {
+    if constexpr (IsBasicString<T>::value) {
+      int o = typename IsBasicString<T>::view(key).compare(value);
+      below = o < 0;
+      above = o > 0;
+    } else {
+      below = less(key, value);
+      above = less(value, key);
+    }
+  }
+};
+
+// With Balanced set the tree is kept red-black: insert and deleteNode recolour and rotate so
+// the height never exceeds 2 * log2(n + 1). Without it the tree is a plain unbalanced BST.
+// Values are ordered by Compare. When Compare declares is_transparent (as std::less<> does),
+// the lookups also accept any key type it can compare with T, so a std::string_view can
+// probe a tree of std::string without building a temporary string.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          bool Balanced = false, typename Stats = NoStats>
+class BST : private Stats
+{
+private:
+  struct Node
+  {
+    T data;
+    Node * parent;
+    Node * left;
+    Node * right;
+    size_t count;  // nodes in the subtree rooted here, including this one
+    bool red;      // only meaningful when Balanced
+
+    template <typename... Args>
+    Node(std::in_place_t, Args &&... args)
+        : data(std::forward<Args>(args)...),
+          parent(nullptr),
+          left(nullptr),
+          right(nullptr),
+          count(1),
+          red(true)
+    {
+    }
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+  Node * root;
+  size_t size;
+  NodeAllocator alloc;
+  Compare less;
+
+  template <typename... Args>
+  Node * createNode(Args &&... args)
+  {
+    Node * node = NodeTraits::allocate(alloc, 1);
+    Stats::onAllocate();
+    try {
+      NodeTraits::construct(alloc, node, std::in_place, std::forward<Args>(args)...);
+    } catch (...) {
+      NodeTraits::deallocate(alloc, node, 1);
+      Stats::onFree();
+      throw;
+    }
+    return node;
+  }
+
+  void destroyNode(Node * node)
+  {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
+    Stats::onFree();
+  }
+
+  static Node * getMinimumPtr(Node * x)
+  {
+    while (x->left) x = x->left;
+    return x;
+  }
+
+  static Node * getMaximumPtr(Node * x)
+  {
+    while (x->right) x = x->right;
+    return x;
+  }
+
+  static size_t subtreeSize(const Node * x) { return x ? x->count : 0; }
+
+  static void updateCount(Node * x) { x->count = 1 + subtreeSize(x->left) + subtreeSize(x->right); }
+
+  // Recomputes subtree sizes on the path from x up to the root after a structural change
+  // below x
+  static void updateCountsUpward(Node * x)
+  {
+    for (; x; x = x->parent) updateCount(x);
+  }
+
+  void transplant(Node * u, Node * v)
+  {
+    if (!(u->parent))
+      root = v;
+    else if (u == u->parent->left)
+      u->parent->left = v;
+    else
+      u->parent->right = v;
+    if (v) v->parent = u->parent;
+  }
+
+  using Order = ThreeWayOrder<T, Compare>;
+
+  // Whether bound, the lower bound of key, holds a value equivalent to key: nothing before it
+  // orders below key, so it matches unless key orders before it
+  template <typename K>
+  bool matchesBound(const K & key, const Node * bound, size_t & calls) const
+  {
+    if (!bound) return false;
+    ++calls;
+    return !less(key, bound->data);
+  }
+
+  // A node whose value is equivalent to key, or nullptr, found in the way ThreeWayOrder
+  // describes. The three-way walk chooses the child with a conditional move rather than a
+  // jump that random keys mispredict half the time.
+  template <typename K>
+  Node * findPtr(const K & key, size_t & steps, size_t & calls) const
+  {
+    Node * x = root;
+    if constexpr (Order::template applies<K>()) {
+      while (x) {
+        ++steps;
+        ++calls;
+        bool below, above;
+        Order::order(less, key, x->data, below, above);
+        if (!(below | above)) break;
+        x = below ? x->left : x->right;
+      }
+      return x;
+    } else {
+      Node * bound = nullptr;
+      while (x) {
+        ++steps;
+        if (less(x->data, key)) {
+          x = x->right;
+        } else {
+          bound = x;
+          x = x->left;
+        }
+      }
+      calls += steps;
+      return matchesBound(key, bound, calls) ? bound : nullptr;
+    }
+  }
+
+  template <typename K>
+  Node * findPtr(const K & key) const
+  {
+    size_t steps = 0;
+    size_t calls = 0;
+    return findPtr(key, steps, calls);
+  }
+
+  template <typename K>
+  Node * search_ptr(const K & key)
+  {
+    size_t steps = 0;
+    size_t calls = 0;
+    Node * x = findPtr(key, steps, calls);
+    Stats::onSearch(steps, calls);
+    return x;
+  }
+
+  // First node whose value is not less than key, or nullptr
+  template <typename K>
+  Node * lowerBoundPtr(Node * x, const K & key) const
+  {
+    Node * result = nullptr;
+    while (x) {
+      if (less(x->data, key)) {
+        x = x->right;
+      } else {
+        result = x;
+        x = x->left;
+      }
+    }
+    return result;
+  }
+
+  // First node whose value is greater than key, or nullptr
+  template <typename K>
+  Node * upperBoundPtr(Node * x, const K & key) const
+  {
+    Node * result = nullptr;
+    while (x) {
+      if (less(key, x->data)) {
+        result = x;
+        x = x->left;
+      } else {
+        x = x->right;
+      }
+    }
+    return result;
+  }
+
+  static Node * successorPtr(Node * x)
+  {
+    if (x->right) return getMinimumPtr(x->right);
+    Node * y = x->parent;
+    while (y && x == y->right) {
+      x = y;
+      y = y->parent;
+    }
+    return y;
+  }
+
+  // Frees a whole subtree in O(n) with constant extra space: left children are rotated up
+  // until the current node has none, then it is freed and the walk continues to its right.
+  void destroyTree(Node * x)
+  {
+    while (x) {
+      if (x->left) {
+        Node * l = x->left;
+        x->left = l->right;
+        l->right = x;
+        x = l;
+      } else {
+        Node * r = x->right;
+        destroyNode(x);
+        x = r;
+      }
+    }
+  }
+
+  // Links nodes[lo, hi), which are in sorted order, into a perfectly balanced subtree and
+  // returns its root. Nodes on the deepest level are coloured red and all others black,
+  // which satisfies the red-black rules since every leaf sits on one of the last two levels.
+  static Node * linkBalanced(Node ** nodes, size_t lo, size_t hi, Node * parent, size_t depth,
+                             size_t deepest)
+  {
+    if (lo == hi) return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    Node * x = nodes[mid];
+    x->parent = parent;
+    x->red = depth == deepest;
+    x->count = hi - lo;
+    x->left = linkBalanced(nodes, lo, mid, x, depth + 1, deepest);
+    x->right = linkBalanced(nodes, mid + 1, hi, x, depth + 1, deepest);
+    return x;
+  }
+
+  // Replaces the (empty) tree with a balanced tree over nodes, sorting them first if needed.
+  void buildBalanced(std::vector<Node *> & nodes)
+  {
+    auto byValue = [this](const Node * a, const Node * b) { return less(a->data, b->data); };
+    if (!std::is_sorted(nodes.begin(), nodes.end(), byValue))
+      std::stable_sort(nodes.begin(), nodes.end(), byValue);
+    size_t deepest = 0;
+    while ((size_t(2) << deepest) <= nodes.size()) ++deepest;  // floor(log2(n))
+    root = linkBalanced(nodes.data(), 0, nodes.size(), nullptr, 0, deepest);
+    if (root) root->red = false;
+    size = nodes.size();
+  }
+
+  static constexpr size_t batch_lanes = 16;
+
+  // Runs search_ptr for every key with the walks interleaved; report(i, node) receives the
+  // outcome for keys[i]. A lane that finishes picks up the next pending key straight away.
+  template <typename Report>
+  void searchBatch(const std::vector<T> & keys, Report report)
+  {
+    if (!root) {
+      for (size_t i = 0; i < keys.size(); ++i) report(i, nullptr);
+      return;
+    }
+    Node * node[batch_lanes];
+    Node * bound[batch_lanes];
+    size_t index[batch_lanes];
+    size_t lanes = 0;
+    size_t next = 0;
+    size_t calls = 0;
+    for (; lanes < batch_lanes && next < keys.size(); ++lanes, ++next) {
+      node[lanes] = root;
+      bound[lanes] = nullptr;
+      index[lanes] = next;
+    }
+    while (lanes) {
+      for (size_t lane = 0; lane < lanes;) {
+        // The steps of findPtr, one level at a time
+        Node * x = node[lane];
+        const T & key = keys[index[lane]];
+        Node * found = nullptr;
+        if constexpr (Order::template applies<T>()) {
+          bool below, above;
+          Order::order(less, key, x->data, below, above);
+          if (below | above) {
+            x = below ? x->left : x->right;
+          } else {
+            found = x;
+            x = nullptr;
+          }
+        } else {
+          bool right = less(x->data, key);
+          bound[lane] = right ? bound[lane] : x;
+          x = right ? x->right : x->left;
+          if (!x && matchesBound(key, bound[lane], calls)) found = bound[lane];
+        }
+        if (x) {
+          prefetch(x);
+          node[lane] = x;
+          ++lane;
+          continue;
+        }
+        report(index[lane], found);
+        if (next < keys.size()) {
+          node[lane] = root;
+          bound[lane] = nullptr;
+          index[lane] = next++;
+          ++lane;
+        } else {
+          // Retire the lane by moving the last active one into its place
+          --lanes;
+          node[lane] = node[lanes];
+          bound[lane] = bound[lanes];
+          index[lane] = index[lanes];
+        }
+      }
+    }
+  }
+
+  void insertNode(Node * z)
+  {
+    Node * x = root;
+    Node * y = nullptr;
+    bool left = false;
+    size_t depth = 1;
+    while (x) {
+      y = x;
+      ++depth;
+      ++x->count;
+      left = less(z->data, x->data);
+      x = left ? x->left : x->right;
+    }
+    linkNode(z, y, left, depth);
+  }
+
+  // Hangs z below parent (as its left child if left is set) at the given depth, once the
+  // subtree sizes on the way down have been counted
+  void linkNode(Node * z, Node * parent, bool left, size_t depth)
+  {
+    z->parent = parent;
+    if (!parent)
+      root = z;
+    else if (left)
+      parent->left = z;
+    else
+      parent->right = z;
+    ++size;
+    Stats::onInsert(depth);
+    if constexpr (Balanced) insertFixup(z);
+  }
+
+  // Finds the value equivalent to key, or links in a new node built from args where key
+  // belongs, in one walk down; the bool of the returned pair tells whether the node is new
+  template <typename K, typename... Args>
+  auto emplaceUnique(const K & key, Args &&... args)
+  {
+    Node * x = root;
+    Node * y = nullptr;
+    bool left = false;
+    size_t depth = 1;
+    size_t calls = 0;
+    if constexpr (Order::template applies<K>()) {
+      while (x) {
+        bool above;
+        Order::order(less, key, x->data, left, above);
+        if (!(left | above)) return std::make_pair(iterator(x), false);
+        y = x;
+        ++depth;
+        x = left ? x->left : x->right;
+      }
+    } else {
+      // As in findPtr; a key with no equivalent belongs below the leaf the walk ends at
+      Node * bound = nullptr;
+      while (x) {
+        y = x;
+        ++depth;
+        left = !less(x->data, key);
+        bound = left ? x : bound;
+        x = left ? x->left : x->right;
+      }
+      if (matchesBound(key, bound, calls)) return std::make_pair(iterator(bound), false);
+    }
+    Node * z = createNode(std::forward<Args>(args)...);
+    for (Node * p = y; p; p = p->parent) ++p->count;
+    linkNode(z, y, left, depth);
+    return std::make_pair(iterator(z), true);
+  }
+
+  static bool isRed(const Node * x) { return x && x->red; }
+
+  void insertFixup(Node * z)
+  {
+    while (isRed(z->parent)) {
+      Node * p = z->parent;
+      Node * g = p->parent;  // exists, since a red node is never the root
+      if (p == g->left) {
+        Node * uncle = g->right;
+        if (isRed(uncle)) {
+          p->red = uncle->red = false;
+          g->red = true;
+          z = g;
+        } else {
+          if (z == p->right) {
+            z = p;
+            left_rotate(z);
+            p = z->parent;
+          }
+          p->red = false;
+          g->red = true;
+          right_rotate(g);
+        }
+      } else {
+        Node * uncle = g->left;
+        if (isRed(uncle)) {
+          p->red = uncle->red = false;
+          g->red = true;
+          z = g;
+        } else {
+          if (z == p->left) {
+            z = p;
+            right_rotate(z);
+            p = z->parent;
+          }
+          p->red = false;
+          g->red = true;
+          left_rotate(g);
+        }
+      }
+    }
+    root->red = false;
+  }
+
+  // x took the place of a removed black node and carries an extra black. x may be null, so
+  // its parent is passed separately.
+  void deleteFixup(Node * x, Node * parent)
+  {
+    while (x != root && !isRed(x)) {
+      if (x == parent->left) {
+        Node * w = parent->right;
+        if (isRed(w)) {
+          w->red = false;
+          parent->red = true;
+          left_rotate(parent);
+          w = parent->right;
+        }
+        if (!isRed(w->left) && !isRed(w->right)) {
+          w->red = true;
+          x = parent;
+          parent = x->parent;
+        } else {
+          if (!isRed(w->right)) {
+            w->left->red = false;
+            w->red = true;
+            right_rotate(w);
+            w = parent->right;
+          }
+          w->red = parent->red;
+          parent->red = false;
+          w->right->red = false;
+          left_rotate(parent);
+          x = root;
+        }
+      } else {
+        Node * w = parent->left;
+        if (isRed(w)) {
+          w->red = false;
+          parent->red = true;
+          right_rotate(parent);
+          w = parent->left;
+        }
+        if (!isRed(w->left) && !isRed(w->right)) {
+          w->red = true;
+          x = parent;
+          parent = x->parent;
+        } else {
+          if (!isRed(w->left)) {
+            w->right->red = false;
+            w->red = true;
+            left_rotate(w);
+            w = parent->left;
+          }
+          w->red = parent->red;
+          parent->red = false;
+          w->left->red = false;
+          right_rotate(parent);
+          x = root;
+        }
+      }
+    }
+    if (x) x->red = false;
+  }
+
+  void eraseNode(Node * z)
+  {
+    Node * y = z;
+    bool removedRed = z->red;
+    Node * x;
+    Node * xParent;
+    if (!(z->left)) {
+      x = z->right;
+      xParent = z->parent;
+      transplant(z, z->right);
+    } else if (!(z->right)) {
+      x = z->left;
+      xParent = z->parent;
+      transplant(z, z->left);
+    } else {
+      y = getMinimumPtr(z->right);
+      removedRed = y->red;
+      x = y->right;
+      xParent = y;
+      if (y->parent != z) {
+        xParent = y->parent;
+        transplant(y, y->right);
+        y->right = z->right;
+        y->right->parent = y;
+      }
+      transplant(z, y);
+      y->left = z->left;
+      y->left->parent = y;
+      y->red = z->red;
+    }
+    destroyNode(z);
+    --size;
+    updateCountsUpward(xParent);
+    if constexpr (Balanced)
+      if (!removedRed) deleteFixup(x, xParent);
+  }
+
+  // Copies the shape and contents of the tree rooted at src into this (empty) tree without
+  // recursion or re-searching: both trees are walked in pre-order in lock-step using parent
+  // links. Each node is attached as soon as it is made, so a throw leaves a valid tree behind.
+  template <typename MakeNode>
+  void cloneFrom(Node * src, MakeNode make)
+  {
+    if (!src) return;
+    root = make(src);
+    root->red = src->red;
+    root->count = src->count;
+    size = 1;
+    Node * dst = root;
+    while (true) {
+      if (src->left && !dst->left) {
+        src = src->left;
+        dst->left = make(src);
+        dst->left->parent = dst;
+        dst->left->red = src->red;
+        dst->left->count = src->count;
+        dst = dst->left;
+        ++size;
+      } else if (src->right && !dst->right) {
+        src = src->right;
+        dst->right = make(src);
+        dst->right->parent = dst;
+        dst->right->red = src->red;
+        dst->right->count = src->count;
+        dst = dst->right;
+        ++size;
+      } else {
+        if (dst == root) break;
+        src = src->parent;
+        dst = dst->parent;
+      }
+    }
+  }
+
+  void copyFrom(const BST & other)
+  {
+    cloneFrom(other.root, [this](Node * src) { return createNode(src->data); });
+  }
+
+  void moveFrom(BST & other)
+  {
+    cloneFrom(other.root, [this](Node * src) { return createNode(std::move(src->data)); });
+  }
+
+  void stealFrom(BST & other) noexcept
+  {
+    root = other.root;
+    size = other.size;
+    other.root = nullptr;
+    other.size = 0;
+  }
+
+  // Rotations on the tree or detached subtree whose root is top; top follows the rotation
+  static void rotateLeft(Node * x, Node *& top)
+  {
+    if (!x || !x->right) return;  // Cannot rotate if x or its right child is null
+
+    Node * y = x->right;  // Set y as the right child of x
+
+    // Turn y's left subtree into x's right subtree
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+
+    // Link x's parent to y
+    y->parent = x->parent;
+    if (!x->parent)  // x was root
+      top = y;
+    else if (x == x->parent->left)  // x was left child
+      x->parent->left = y;
+    else  // x was right child
+      x->parent->right = y;
+
+    // Put x on y's left
+    y->left = x;
+    x->parent = y;
+
+    // y now roots the subtree x used to root
+    y->count = x->count;
+    updateCount(x);
+  }
+
+  static void rotateRight(Node * y, Node *& top)
+  {
+    if (!y || !y->left) return;  // Cannot rotate if y or its left child is null
+
+    Node * x = y->left;  // Set x as the left child of y
+
+    // Turn x's right subtree into y's left subtree
+    y->left = x->right;
+    if (x->right) x->right->parent = y;
+
+    // Link y's parent to x
+    x->parent = y->parent;
+    if (!y->parent)  // y was root
+      top = x;
+    else if (y == y->parent->left)  // y was left child
+      y->parent->left = x;
+    else  // y was right child
+      y->parent->right = x;
+
+    // Put y on x's right
+    x->right = y;
+    y->parent = x;
+
+    // x now roots the subtree y used to root
+    x->count = y->count;
+    updateCount(y);
+  }
+
+  void left_rotate(Node * x)
+  {
+    Stats::onRotation();
+    rotateLeft(x, root);
+  }
+
+  void right_rotate(Node * y)
+  {
+    Stats::onRotation();
+    rotateRight(y, root);
+  }
+
+  // A detached subtree (root->parent is null) together with its black height, the number of
+  // black nodes on every path from the root down to a null child. In Balanced mode every
+  // part has a black root; otherwise the black height is unused and left at 0.
+  struct Part
+  {
+    Node * root = nullptr;
+    size_t blackHeight = 0;
+  };
+
+  static size_t blackHeightOf(const Node * x)
+  {
+    size_t height = 0;
+    if constexpr (Balanced)
+      for (; x; x = x->left) height += !x->red;
+    return height;
+  }
+
+  // Detaches child x of a node whose black height, counting that node, was parentHeight
+  static Part detachChild(Node * x, size_t parentHeight, bool parentRed)
+  {
+    if (!x) return {};
+    x->parent = nullptr;
+    if constexpr (!Balanced) {
+      return {x, 0};
+    } else {
+      size_t height = parentHeight - !parentRed;
+      if (x->red) {
+        x->red = false;
+        ++height;
+      }
+      return {x, height};
+    }
+  }
+
+  // Links l, k and r, where every value of l is not greater than k and every value of r is
+  // not less, into one part. An unbalanced tree just puts k on top. A red-black join walks
+  // down the spine of the taller part to a black node of the other's black height, hangs k
+  // there in red and repairs upwards, which costs O(1 + difference in black heights).
+  static Part joinParts(Part l, Node * k, Part r)
+  {
+    k->parent = nullptr;
+    if constexpr (Balanced) {
+      if (l.blackHeight != r.blackHeight) {
+        bool leftTaller = l.blackHeight > r.blackHeight;
+        Part & tall = leftTaller ? l : r;
+        Part & small = leftTaller ? r : l;
+        Node * top = tall.root;
+        Node * p = nullptr;
+        Node * c = top;
+        size_t height = tall.blackHeight;
+        while (c && (c->red || height != small.blackHeight)) {
+          height -= !c->red;
+          p = c;
+          c = leftTaller ? c->right : c->left;
+        }
+        k->red = true;
+        k->parent = p;
+        if (leftTaller) {
+          k->left = c;
+          k->right = small.root;
+          p->right = k;
+        } else {
+          k->left = small.root;
+          k->right = c;
+          p->left = k;
+        }
+        if (c) c->parent = k;
+        if (small.root) small.root->parent = k;
+        updateCount(k);
+        updateCountsUpward(p);
+        // Every node from k up is on the spine, so only the outer rotation case arises
+        for (Node * z = k; isRed(z->parent);) {
+          Node * q = z->parent;
+          Node * g = q->parent;  // exists, since the top is black
+          Node * uncle = leftTaller ? g->left : g->right;
+          if (isRed(uncle)) {
+            q->red = uncle->red = false;
+            g->red = true;
+            z = g;
+          } else {
+            if (leftTaller)
+              rotateLeft(g, top);
+            else
+              rotateRight(g, top);
+            q->red = false;
+            g->red = true;
+            break;
+          }
+        }
+        size_t blackHeight = tall.blackHeight;
+        if (top->red) {
+          top->red = false;
+          ++blackHeight;
+        }
+        return {top, blackHeight};
+      }
+      k->red = false;
+    }
+    k->left = l.root;
+    k->right = r.root;
+    if (l.root) l.root->parent = k;
+    if (r.root) r.root->parent = k;
+    updateCount(k);
+    return {k, Balanced ? l.blackHeight + 1 : 0};
+  }
+
+  // Splits t into the values that go before key (those less than key, or not greater than
+  // key when inclusive) and the rest, in O(height). The red-black split takes the path to
+  // key apart and joins the pieces hanging off it; an unbalanced tree is cut along the path.
+  static void splitPart(const Compare & less, Part t, const T & key, bool inclusive, Part & l,
+                        Part & r)
+  {
+    auto goesLeft = [&less, &key, inclusive](const Node * x) {
+      return inclusive ? !less(key, x->data) : less(x->data, key);
+    };
+    if constexpr (!Balanced) {
+      Node * lroot = nullptr;
+      Node * rroot = nullptr;
+      Node ** lhook = &lroot;
+      Node ** rhook = &rroot;
+      Node * ltail = nullptr;
+      Node * rtail = nullptr;
+      for (Node * x = t.root; x;) {
+        if (goesLeft(x)) {
+          *lhook = x;
+          x->parent = ltail;
+          ltail = x;
+          lhook = &x->right;
+          x = x->right;
+        } else {
+          *rhook = x;
+          x->parent = rtail;
+          rtail = x;
+          rhook = &x->left;
+          x = x->left;
+        }
+      }
+      *lhook = nullptr;
+      *rhook = nullptr;
+      updateCountsUpward(ltail);
+      updateCountsUpward(rtail);
+      l = {lroot, 0};
+      r = {rroot, 0};
+    } else {
+      Node * x = t.root;
+      if (!x) {
+        l = r = {};
+        return;
+      }
+      Part left = detachChild(x->left, t.blackHeight, x->red);
+      Part right = detachChild(x->right, t.blackHeight, x->red);
+      Part rest;
+      if (goesLeft(x)) {
+        splitPart(less, right, key, inclusive, rest, r);
+        l = joinParts(left, x, rest);
+      } else {
+        splitPart(less, left, key, inclusive, l, rest);
+        r = joinParts(rest, x, right);
+      }
+    }
+  }
+
+  // Removes the largest node of the non-empty part t and returns it; rest receives the
+  // remaining nodes. An unbalanced tree has the node cut off the end of its right spine in
+  // a loop, as that spine may be as long as the tree.
+  static Node * splitLast(Part t, Part & rest)
+  {
+    Node * x = t.root;
+    if constexpr (!Balanced) {
+      while (x->right) x = x->right;
+      Node * p = x->parent;
+      if (x->left) x->left->parent = p;
+      if (p) {
+        p->right = x->left;
+        updateCountsUpward(p);
+        rest = t;
+      } else {
+        rest = {x->left, 0};
+      }
+      x->left = x->parent = nullptr;
+      x->count = 1;
+      return x;
+    } else {
+      Part left = detachChild(x->left, t.blackHeight, x->red);
+      if (!x->right) {
+        rest = left;
+        return x;
+      }
+      Part right = detachChild(x->right, t.blackHeight, x->red);
+      Node * last = splitLast(right, rest);
+      rest = joinParts(left, x, rest);
+      return last;
+    }
+  }
+
+  // Concatenation of l and r where no value of l is greater than any value of r
+  static Part joinParts(Part l, Part r)
+  {
+    if (!l.root) return r;
+    if (!r.root) return l;
+    Part rest;
+    Node * k = splitLast(l, rest);
+    return joinParts(rest, k, r);
+  }
+
+  Part wholeTree() const { return {root, blackHeightOf(root)}; }
+
+  // Relinks the nodes of the detached subtree x into a perfectly balanced one. Set
+  // operations do this to unbalanced trees first so that their recursion stays shallow.
+  static Node * relinkBalanced(Node * x)
+  {
+    if (!x) return x;
+    std::vector<Node *> nodes;
+    nodes.reserve(x->count);
+    for (Node * y = getMinimumPtr(x); y; y = successorPtr(y)) nodes.push_back(y);
+    size_t deepest = 0;
+    while ((size_t(2) << deepest) <= nodes.size()) ++deepest;
+    return linkBalanced(nodes.data(), 0, nodes.size(), nullptr, 0, deepest);
+  }
+
+  enum class SetOperation { Union, Intersection, Difference };
+
+  // Subproblems smaller than this are not worth handing to another thread
+  static constexpr size_t parallel_grain = size_t(1) << 14;
+
+  // Divide and conquer in the style of join-based parallel ordered sets: b's root value k
+  // splits a into the values below, equal to and above k, the two sides are combined
+  // recursively (in parallel while forks remain and the work is large enough) and joined
+  // back around the copies of k that the operation keeps. Duplicates follow the multiset
+  // rules of std::set_union, std::set_intersection and std::set_difference. Nodes that drop
+  // out are detached subtrees collected in garbage for the caller to free, so the workers
+  // never touch the allocator.
+  static Part combine(const Compare & less, SetOperation op, Part a, Part b, unsigned forks,
+                      std::vector<Node *> & garbage)
+  {
+    if (!a.root || !b.root) {
+      if (op == SetOperation::Union) return a.root ? a : b;
+      if (b.root) garbage.push_back(b.root);
+      if (op == SetOperation::Difference) return a;
+      if (a.root) garbage.push_back(a.root);
+      return {};
+    }
+    bool parallel = forks && a.root->count + b.root->count >= parallel_grain;
+
+    Node * k = b.root;
+    const T & key = k->data;
+    Part bLeft = detachChild(k->left, b.blackHeight, k->red);
+    Part bRight = detachChild(k->right, b.blackHeight, k->red);
+    k->left = k->right = nullptr;
+    k->count = 1;
+
+    // Only runs of duplicates need the second split on each side; with distinct keys a
+    // look at the neighbouring extreme value is enough to see that it would be empty
+    Part aLess, aEqual, aGreater, bLess, bLowEqual, bHighEqual, bGreater;
+    splitPart(less, a, key, false, aLess, aGreater);
+    if (aGreater.root && !less(key, getMinimumPtr(aGreater.root)->data))
+      splitPart(less, aGreater, key, true, aEqual, aGreater);
+    bLess = bLeft;
+    if (bLeft.root && !less(getMaximumPtr(bLeft.root)->data, key))
+      splitPart(less, bLeft, key, false, bLess, bLowEqual);
+    bGreater = bRight;
+    if (bRight.root && !less(key, getMinimumPtr(bRight.root)->data))
+      splitPart(less, bRight, key, true, bHighEqual, bGreater);
+
+    size_t fromA = subtreeSize(aEqual.root);
+    size_t fromB = 1 + subtreeSize(bLowEqual.root) + subtreeSize(bHighEqual.root);
+    size_t kept;
+    if (op == SetOperation::Union)
+      kept = std::max(fromA, fromB);
+    else if (op == SetOperation::Intersection)
+      kept = std::min(fromA, fromB);
+    else
+      kept = fromA > fromB ? fromA - fromB : 0;
+
+    // The kept copies of key, the last of which becomes the pivot of the final join. Copies
+    // from a come before those from b. Without duplicates there is only k to decide on.
+    std::vector<Node *> equal;
+    Node * pivot = nullptr;
+    if (fromA + fromB == 1) {
+      if (kept)
+        pivot = k;
+      else
+        garbage.push_back(k);
+    } else {
+      equal.reserve(fromA + fromB);
+      for (Part part : {aEqual, bLowEqual}) {
+        if (!part.root) continue;
+        for (Node * x = getMinimumPtr(part.root); x; x = successorPtr(x)) equal.push_back(x);
+      }
+      equal.push_back(k);
+      if (bHighEqual.root)
+        for (Node * x = getMinimumPtr(bHighEqual.root); x; x = successorPtr(x))
+          equal.push_back(x);
+      for (size_t i = kept; i < equal.size(); ++i) {
+        equal[i]->left = equal[i]->right = nullptr;
+        garbage.push_back(equal[i]);
+      }
+      equal.resize(kept);
+      if (kept) {
+        pivot = equal.back();
+        equal.pop_back();
+      }
+    }
+
+    Part below, above;
+    if (parallel) {
+      std::vector<Node *> greaterGarbage;
+      auto task = std::async(std::launch::async | std::launch::deferred, [&] {
+        return combine(less, op, aGreater, bGreater, forks / 2, greaterGarbage);
+      });
+      below = combine(less, op, aLess, bLess, forks / 2, garbage);
+      above = task.get();
+      garbage.insert(garbage.end(), greaterGarbage.begin(), greaterGarbage.end());
+    } else {
+      below = combine(less, op, aLess, bLess, 0, garbage);
+      above = combine(less, op, aGreater, bGreater, 0, garbage);
+    }
+
+    if (!pivot) return joinParts(below, above);
+    size_t deepest = 0;
+    while ((size_t(2) << deepest) <= equal.size()) ++deepest;
+    Node * middle = linkBalanced(equal.data(), 0, equal.size(), nullptr, 0, deepest);
+    if (middle) middle->red = false;
+    return joinParts(joinParts(below, {middle, blackHeightOf(middle)}), pivot, above);
+  }
+
+  // Copy of other built with this tree's allocator, whose nodes combineWith can relink
+  BST adoptedCopy(const BST & other) const
+  {
+    BST adopted(less, get_allocator());
+    adopted.copyFrom(other);
+    return adopted;
+  }
+
+  // Replaces the contents with op(this, other), reusing the nodes of both trees
+  void combineWith(SetOperation op, BST && other)
+  {
+    if (!(alloc == other.alloc)) {
+      combineWith(op, adoptedCopy(other));
+      return;
+    }
+    if constexpr (!Balanced) {
+      root = relinkBalanced(root);
+      other.root = relinkBalanced(other.root);
+    }
+    unsigned forks = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Node *> garbage;
+    Part result = combine(less, op, wholeTree(), other.wholeTree(), forks - 1, garbage);
+    root = result.root;
+    size = subtreeSize(root);
+    other.root = nullptr;
+    other.size = 0;
+    for (Node * x : garbage) destroyTree(x);
+  }
+
+  template <typename K, typename V, typename C, typename A, bool B>
+  friend class BSTMap;
+
+public:
+  class iterator;
+  class const_iterator;
+
+  using allocator_type = Allocator;
+  using key_compare = Compare;
+
+  BST() : BST(Compare(), Allocator()) {}
+  explicit BST(const Allocator & allocator) : BST(Compare(), allocator) {}
+  explicit BST(const Compare & compare, const Allocator & allocator = Allocator())
+      : root(nullptr), size(0), alloc(allocator), less(compare)
+  {
+  }
+
+  BST(const BST & other)
+      : BST(other.less,
+            Allocator(NodeTraits::select_on_container_copy_construction(other.alloc)))
+  {
+    copyFrom(other);
+  }
+
+  BST(BST && other) noexcept
+      : root(nullptr), size(0), alloc(std::move(other.alloc)), less(other.less)
+  {
+    stealFrom(other);
+  }
+
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  BST(InputIt first, InputIt last, const Compare & compare = Compare(),
+      const Allocator & allocator = Allocator())
+      : BST(compare, allocator)
+  {
+    assign(first, last);
+  }
+
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  BST(InputIt first, InputIt last, const Allocator & allocator) : BST(Compare(), allocator)
+  {
+    assign(first, last);
+  }
+
+  BST & operator=(const BST & other)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) alloc = other.alloc;
+    less = other.less;
+    copyFrom(other);
+    return *this;
+  }
+
+  BST & operator=(BST && other) noexcept(
+    NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    clear();
+    less = other.less;
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+      alloc = std::move(other.alloc);
+      stealFrom(other);
+    } else {
+      if (alloc == other.alloc) {
+        stealFrom(other);
+      } else {
+        moveFrom(other);
+        other.clear();
+      }
+    }
+    return *this;
+  }
+
+  ~BST() { clear(); }
+
+  allocator_type get_allocator() const { return allocator_type(alloc); }
+  key_compare key_comp() const { return less; }
+
+  // Copy of the counters gathered by the Stats policy since construction or the last reset.
+  // With counting enabled it also measures the current height, which takes O(n).
+  Stats stats() const
+  {
+    Stats snapshot = static_cast<const Stats &>(*this);
+    if constexpr (Stats::enabled) snapshot.height = getHeight();
+    return snapshot;
+  }
+  void reset_stats() { static_cast<Stats &>(*this) = Stats(); }
+
+  size_t getSize() const { return size; }
+  bool empty() const { return !size; }
+
+  void clear() noexcept
+  {
+    destroyTree(root);
+    root = nullptr;
+    size = 0;
+  }
+
+  // Replaces the contents with the values in [first, last). The values go into their nodes
+  // once and the nodes are linked into a perfectly balanced tree in O(n) when the range is
+  // already sorted, or O(n log n) for the sort otherwise.
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last)
+  {
+    clear();
+    std::vector<Node *> nodes;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                    typename std::iterator_traits<InputIt>::iterator_category>)
+      nodes.reserve(std::distance(first, last));
+    try {
+      for (; first != last; ++first) {
+        Node * node = createNode(*first);
+        try {
+          nodes.push_back(node);
+        } catch (...) {
+          destroyNode(node);
+          throw;
+        }
+      }
+    } catch (...) {
+      for (Node * node : nodes) destroyNode(node);
+      throw;
+    }
+    buildBalanced(nodes);
+  }
+
+  // Writes the values in sorted order to a snapshot file (see SnapshotHeader). The file is
+  // only marked sorted when Compare agrees with the operator< that SnapshotView searches by.
+  void save(const std::string & path) const
+  {
+    constexpr bool natural =
+      std::is_same_v<Compare, std::less<T>> || std::is_same_v<Compare, std::less<>>;
+    writeSnapshot<T>(path, cbegin(), size, natural);
+  }
+
+  // Rebuilds a tree from a snapshot file. The values are already sorted, so they are copied
+  // into their nodes and linked into a balanced tree in a single O(n) pass over the mapping.
+  static BST load(const std::string & path, const Allocator & allocator = Allocator())
+  {
+    SnapshotView<T> view(path);
+    return BST(view.begin(), view.end(), allocator);
+  }
+
+  void deleteNode(const T & data)
+  {
+    Node * z = search_ptr(data);
+    if (!z) return;
+    eraseNode(z);
+  }
+
+  // Removes every value v with lo <= v <= hi and returns how many were removed. The run of
+  // nodes is walked in order from lower_bound(lo) without searching again for each key. When
+  // it covers a large share of the tree, the survivors are relinked into a balanced tree in
+  // O(n) instead, which is cheaper than that many single deletions.
+  size_t erase_range(const T & lo, const T & hi)
+  {
+    size_t k = count_range(lo, hi);
+    if (!k) return 0;
+    if (2 * k < size) {
+      Node * x = lowerBoundPtr(root, lo);
+      for (size_t i = 0; i < k; ++i) {
+        // eraseNode only ever frees the node it is given, so the successor stays valid
+        Node * next = successorPtr(x);
+        eraseNode(x);
+        x = next;
+      }
+      return k;
+    }
+    std::vector<Node *> nodes;
+    nodes.reserve(size);
+    for (Node * x = getMinimumPtr(root); x; x = successorPtr(x)) nodes.push_back(x);
+    size_t first = rank(lo);
+    for (size_t i = first; i < first + k; ++i) destroyNode(nodes[i]);
+    nodes.erase(nodes.begin() + first, nodes.begin() + first + k);
+    root = nullptr;
+    buildBalanced(nodes);
+    return k;
+  }
+
+  // Moves every value not less than key into the returned tree and keeps the smaller ones,
+  // in O(log n) for a red-black tree and O(height) otherwise
+  BST split(const T & key)
+  {
+    Part lower, upper;
+    splitPart(less, wholeTree(), key, false, lower, upper);
+    BST result(less, get_allocator());
+    result.root = upper.root;
+    result.size = subtreeSize(upper.root);
+    root = lower.root;
+    size = subtreeSize(lower.root);
+    return result;
+  }
+
+  // Concatenates two trees where no value of left is greater than any value of right,
+  // in O(log n) for red-black trees
+  static BST join(BST left, BST right)
+  {
+    if (!(left.alloc == right.alloc)) {
+      BST adopted(left.less, left.get_allocator());
+      adopted.copyFrom(right);
+      return join(std::move(left), std::move(adopted));
+    }
+    Part joined = joinParts(left.wholeTree(), right.wholeTree());
+    left.root = joined.root;
+    left.size += right.size;
+    right.root = nullptr;
+    right.size = 0;
+    return left;
+  }
+
+  // Multiset union, intersection and difference with other, whose nodes are reused. They
+  // take O(m log(n / m + 1)) work for trees of sizes m <= n in red-black mode and fork
+  // across hardware threads on large inputs. Pass std::move(other) to avoid a copy; a const
+  // other is copied once, straight into this tree's allocator.
+  void union_with(BST && other) { combineWith(SetOperation::Union, std::move(other)); }
+  void intersect_with(BST && other) { combineWith(SetOperation::Intersection, std::move(other)); }
+  void difference(BST && other) { combineWith(SetOperation::Difference, std::move(other)); }
+  void union_with(const BST & other) { combineWith(SetOperation::Union, adoptedCopy(other)); }
+  void intersect_with(const BST & other)
+  {
+    combineWith(SetOperation::Intersection, adoptedCopy(other));
+  }
+  void difference(const BST & other) { combineWith(SetOperation::Difference, adoptedCopy(other)); }
+
+  void insert(const T & data) { insertNode(createNode(data)); }
+  void insert(T && data) { insertNode(createNode(std::move(data))); }
+
+  // Constructs the value in place inside its node and then links the node in, so no
+  // temporary T is made.
+  template <typename... Args>
+  void emplace(Args &&... args)
+  {
+    insertNode(createNode(std::forward<Args>(args)...));
+  }
+
+  bool search(const T & data) { return search_ptr(data); }
+
+  // Heterogeneous overloads of the lookups, for a transparent Compare only
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool search(const K & key)
+  {
+    return search_ptr(key);
+  }
+
+  // Iterator to the first value equivalent to data, or end()
+  iterator find(const T & data) { return iterator(search_ptr(data)); }
+  const_iterator find(const T & data) const { return const_iterator(findPtr(data)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator find(const K & key)
+  {
+    return iterator(search_ptr(key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K & key) const
+  {
+    return const_iterator(findPtr(key));
+  }
+
+  // Looks up every key in keys and stores an iterator to a matching value (or end()) at the
+  // same index in results. Up to batch_lanes lookups are walked in lock-step, each prefetching
+  // its next node before the others take their turn, so the cache misses of independent
+  // searches overlap instead of being paid one after another.
+  void search_batch(const std::vector<T> & keys, std::vector<iterator> & results)
+  {
+    results.assign(keys.size(), end());
+    searchBatch(keys, [&results](size_t i, Node * x) { results[i] = iterator(x); });
+  }
+
+  void contains_batch(const std::vector<T> & keys, std::vector<bool> & results)
+  {
+    results.assign(keys.size(), false);
+    searchBatch(keys, [&results](size_t i, Node * x) { results[i] = x != nullptr; });
+  }
+
+  // Half-open run [begin(), end()) of in-order positions, as returned by range()
+  template <typename Iterator>
+  class range_view
+  {
+  private:
+    Iterator first;
+    Iterator last;
+    range_view(Iterator first, Iterator last) : first(first), last(last) {}
+    friend class BST;
+
+  public:
+    Iterator begin() const { return first; }
+    Iterator end() const { return last; }
+    bool empty() const { return first == last; }
+  };
+
+  // Bounds in O(height); end() when there is no such value
+  iterator lower_bound(const T & data) { return iterator(lowerBoundPtr(root, data)); }
+  iterator upper_bound(const T & data) { return iterator(upperBoundPtr(root, data)); }
+  const_iterator lower_bound(const T & data) const
+  {
+    return const_iterator(lowerBoundPtr(root, data));
+  }
+  const_iterator upper_bound(const T & data) const
+  {
+    return const_iterator(upperBoundPtr(root, data));
+  }
+
+  std::pair<iterator, iterator> equal_range(const T & data)
+  {
+    return {lower_bound(data), upper_bound(data)};
+  }
+  std::pair<const_iterator, const_iterator> equal_range(const T & data) const
+  {
+    return {lower_bound(data), upper_bound(data)};
+  }
+
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator lower_bound(const K & key)
+  {
+    return iterator(lowerBoundPtr(root, key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator upper_bound(const K & key)
+  {
+    return iterator(upperBoundPtr(root, key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K & key) const
+  {
+    return const_iterator(lowerBoundPtr(root, key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K & key) const
+  {
+    return const_iterator(upperBoundPtr(root, key));
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  std::pair<iterator, iterator> equal_range(const K & key)
+  {
+    return {lower_bound(key), upper_bound(key)};
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  std::pair<const_iterator, const_iterator> equal_range(const K & key) const
+  {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  // Values v with lo <= v <= hi in order. Only the matching nodes are visited, so iterating
+  // the view costs O(height + k) for k matches.
+  range_view<iterator> range(const T & lo, const T & hi)
+  {
+    iterator first = lower_bound(lo);
+    return {first, less(hi, lo) ? first : upper_bound(hi)};
+  }
+  range_view<const_iterator> range(const T & lo, const T & hi) const
+  {
+    const_iterator first = lower_bound(lo);
+    return {first, less(hi, lo) ? first : upper_bound(hi)};
+  }
+
+  T getMinimum()
+  {
+    if (empty()) throw out_of_range("Can't find minimum when empty.");
+    return getMinimumPtr(root)->data;
+  }
+
+  T getMaximum()
+  {
+    if (empty()) throw out_of_range("Can't find maximum when empty.");
+    return getMaximumPtr(root)->data;
+  }
+
+  // k-th smallest value, counting from 0, in O(height)
+  T select(size_t k) const
+  {
+    if (k >= size) throw out_of_range("Select index out of range.");
+    const Node * x = root;
+    while (true) {
+      size_t leftSize = subtreeSize(x->left);
+      if (k < leftSize) {
+        x = x->left;
+      } else if (k == leftSize) {
+        return x->data;
+      } else {
+        k -= leftSize + 1;
+        x = x->right;
+      }
+    }
+  }
+
+  // Number of values strictly less than data, in O(height)
+  size_t rank(const T & data) const
+  {
+    size_t r = 0;
+    for (const Node * x = root; x;) {
+      if (less(x->data, data)) {
+        r += subtreeSize(x->left) + 1;
+        x = x->right;
+      } else {
+        x = x->left;
+      }
+    }
+    return r;
+  }
+
+  // Number of values v with lo <= v <= hi, in O(height)
+  size_t count_range(const T & lo, const T & hi) const
+  {
+    if (less(hi, lo)) return 0;
+    size_t notAbove = 0;  // values <= hi
+    for (const Node * x = root; x;) {
+      if (less(hi, x->data)) {
+        x = x->left;
+      } else {
+        notAbove += subtreeSize(x->left) + 1;
+        x = x->right;
+      }
+    }
+    return notAbove - rank(lo);
+  }
+
+  // Height of the tree in nodes (0 when empty). Walks the tree iteratively in O(n).
+  size_t getHeight() const
+  {
+    size_t height = 0;
+    size_t depth = 1;
+    const Node * x = root;
+    const Node * from = nullptr;
+    while (x) {
+      if (depth > height) height = depth;
+      if (from == x->parent && x->left) {
+        from = x;
+        x = x->left;
+        ++depth;
+      } else if ((from == x->parent || from == x->left) && x->right) {
+        from = x;
+        x = x->right;
+        ++depth;
+      } else {
+        from = x;
+        x = x->parent;
+        --depth;
+      }
+    }
+    return height;
+  }
+
+  // Read-only snapshot of the current contents in a cache-friendly array layout, for trees
+  // that are built once and then searched many times.
+  FrozenSet<T, Compare> freeze() const
+  {
+    std::vector<const T *> sorted;
+    sorted.reserve(size);
+    for (auto it = cbegin(); it != cend(); ++it) sorted.push_back(&*it);
+    return FrozenSet<T, Compare>(sorted, less);
+  }
+
+  // Manual rotations would break the red-black invariants, so they are refused in
+  // balanced mode.
+  bool left_rotate(const T & data)
+  {
+    if constexpr (Balanced) return false;
+    Node * node = search_ptr(data);
+    if (!node || !node->right) return false;  // Node must exist and have a right child
+
+    left_rotate(node);
+    return true;
+  }
+
+  bool right_rotate(const T & data)
+  {
+    if constexpr (Balanced) return false;
+    Node * node = search_ptr(data);
+    if (!node || !node->left) return false;  // Node must exist and have a left child
+
+    right_rotate(node);
+    return true;
+  }
+
+  iterator begin() { return iterator(root ? getMinimumPtr(root) : nullptr); }
+  iterator end() { return iterator(nullptr); }
+  const_iterator cbegin() const { return const_iterator(root ? getMinimumPtr(root) : nullptr); }
+  const_iterator cend() const { return const_iterator(nullptr); }
+
+  class iterator
+  {
+  private:
+    Node * current;
+    explicit iterator(Node * node) : current(node) {}
+    friend class BST;
+
+    Node * getSuccessor(Node * x)
+    {
+      if (x->right) {
+        Node * temp = x->right;
+        while (temp->left) temp = temp->left;
+        return temp;
+      }
+      Node * y = x->parent;
+      while (y && x == y->right) {
+        x = y;
+        y = y->parent;
+      }
+      return y;
+    }
+
+    Node * getPredecessor(Node * x)
+    {
+      if (x->left) {
+        Node * temp = x->left;
+        while (temp->right) temp = temp->right;
+        return temp;
+      }
+      Node * y = x->parent;
+      while (y && x == y->left) {
+        x = y;
+        y = y->parent;
+      }
+      return y;
+    }
+
+  public:
+    T & operator*() { return current->data; }
+    iterator & operator++()
+    {
+      current = getSuccessor(current);
+      return *this;
+    }
+    iterator operator++(int)
+    {
+      iterator temp = *this;
+      current = getSuccessor(current);
+      return temp;
+    }
+    iterator & operator--()
+    {
+      current = getPredecessor(current);
+      return *this;
+    }
+    iterator operator--(int)
+    {
+      iterator temp = *this;
+      current = getPredecessor(current);
+      return temp;
+    }
+    bool operator==(const iterator & other) const { return current == other.current; }
+    bool operator!=(const iterator & other) const { return current != other.current; }
+  };
+
+  class const_iterator
+  {
+  private:
+    const Node * current;
+    explicit const_iterator(const Node * node) : current(node) {}
+    friend class BST;
+
+    Node * getSuccessor(Node * x) const
+    {
+      if (x->right) {
+        Node * temp = x->right;
+        while (temp->left) temp = temp->left;
+        return temp;
+      }
+      Node * y = x->parent;
+      while (y && x == y->right) {
+        x = y;
+        y = y->parent;
+      }
+      return y;
+    }
+
+    Node * getPredecessor(Node * x) const
+    {
+      if (x->left) {
+        Node * temp = x->left;
+        while (temp->right) temp = temp->right;
+        return temp;
+      }
+      Node * y = x->parent;
+      while (y && x == y->left) {
+        x = y;
+        y = y->parent;
+      }
+      return y;
+    }
+
+  public:
+    const T & operator*() const { return current->data; }
+    const_iterator & operator++()
+    {
+      current = getSuccessor(const_cast<Node *>(current));
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      current = getSuccessor(const_cast<Node *>(current));
+      return temp;
+    }
+    const_iterator & operator--()
+    {
+      current = getPredecessor(const_cast<Node *>(current));
+      return *this;
+    }
+    const_iterator operator--(int)
+    {
+      const_iterator temp = *this;
+      current = getPredecessor(const_cast<Node *>(current));
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const { return current == other.current; }
+    bool operator!=(const const_iterator & other) const { return current != other.current; }
+  };
+};
+
+// Ordered map on a BST whose nodes hold std::pair<const K, V> and are ordered by key alone,
+// so lookups take a bare key instead of a pair with a dummy value. Keys are unique:
+// try_emplace and operator[] find the key or the leaf it belongs at in one walk down.
+// Iterators are those of the underlying tree, yielding the pairs in key order.
+template <typename K, typename V, typename Compare = std::less<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>, bool Balanced = true>
+class BSTMap
+{
+public:
+  using value_type = std::pair<const K, V>;
+
+private:
+  // Orders pairs by key, and pairs against bare keys in either order
+  struct KeyCompare
+  {
+    using is_transparent = void;
+
+    Compare less;
+
+    bool operator()(const value_type & a, const value_type & b) const
+    {
+      return less(a.first, b.first);
+    }
+    template <typename L>
+    bool operator()(const value_type & a, const L & b) const
+    {
+      return less(a.first, b);
+    }
+    template <typename L>
+    bool operator()(const L & a, const value_type & b) const
+    {
+      return less(a, b.first);
+    }
+  };
+
+  using Tree = BST<value_type, KeyCompare, Allocator, Balanced>;
+
+  Tree tree;
+
+public:
+  using iterator = typename Tree::iterator;
+  using const_iterator = typename Tree::const_iterator;
+  using allocator_type = Allocator;
+
+  BSTMap() = default;
+  explicit BSTMap(const Allocator & allocator) : tree(allocator) {}
+  explicit BSTMap(const Compare & compare, const Allocator & allocator = Allocator())
+      : tree(KeyCompare{compare}, allocator)
+  {
+  }
+
+  allocator_type get_allocator() const { return tree.get_allocator(); }
+
+  size_t getSize() const { return tree.getSize(); }
+  bool empty() const { return tree.empty(); }
+  void clear() noexcept { tree.clear(); }
+
+  // Iterator to the pair with the given key, or end(). The template overloads take any key
+  // type a transparent Compare accepts.
+  iterator find(const K & key) { return tree.find(key); }
+  const_iterator find(const K & key) const { return tree.find(key); }
+  template <typename L, typename C = Compare, typename = typename C::is_transparent>
+  iterator find(const L & key)
+  {
+    return tree.find(key);
+  }
+  template <typename L, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const L & key) const
+  {
+    return tree.find(key);
+  }
+
+  bool search(const K & key) const { return tree.findPtr(key); }
+
+  // Inserts a pair of key and V(args...) unless the key is present, in which case nothing
+  // is constructed. Returns the pair for the key and whether it was inserted.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K & key, Args &&... args)
+  {
+    return tree.emplaceUnique(key, std::piecewise_construct, std::forward_as_tuple(key),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K && key, Args &&... args)
+  {
+    return tree.emplaceUnique(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  // Value for key, inserting a value-initialized one first if the key is absent
+  V & operator[](const K & key) { return (*try_emplace(key).first).second; }
+  V & operator[](K && key) { return (*try_emplace(std::move(key)).first).second; }
+
+  V & at(const K & key)
+  {
+    auto * node = tree.findPtr(key);
+    if (!node) throw out_of_range("Key not found.");
+    return node->data.second;
+  }
+  const V & at(const K & key) const
+  {
+    auto * node = tree.findPtr(key);
+    if (!node) throw out_of_range("Key not found.");
+    return node->data.second;
+  }
+
+  // Removes the pair with the given key, if any, and reports whether there was one
+  bool erase(const K & key)
+  {
+    auto * node = tree.findPtr(key);
+    if (!node) return false;
+    tree.eraseNode(node);
+    return true;
+  }
+
+  iterator lower_bound(const K & key) { return tree.lower_bound(key); }
+  iterator upper_bound(const K & key) { return tree.upper_bound(key); }
+  const_iterator lower_bound(const K & key) const { return tree.lower_bound(key); }
+  const_iterator upper_bound(const K & key) const { return tree.upper_bound(key); }
+
+  iterator begin() { return tree.begin(); }
+  iterator end() { return tree.end(); }
+  const_iterator cbegin() const { return tree.cbegin(); }
+  const_iterator cend() const { return tree.cend(); }
+};
+
+// Slot orders for CompactBST::compact
+enum class CompactOrder
+{
+  InOrder,      // sorted order: iteration walks the array front to back
+  VanEmdeBoas,  // recursive blocks of subtrees: any root-to-leaf path touches few cache lines
+};
+
+// BST whose nodes live in one contiguous array of slots and refer to each other by 32-bit
+// slot index rather than by pointer. For small keys a node is well under half the size of a
+// BST node (20 bytes against 48 for int, as there are no subtree counts either), and
+// neighbouring slots share cache lines. Erased slots go on a free list for reuse, and
+// compact() renumbers the nodes into a gap-free array in a chosen order. Inserting may
+// move the array, so iterators are only valid until the next insert or compact. Values are
+// ordered by Compare, with the transparent lookups of BST, and with Balanced set the tree
+// is kept red-black, as for BST.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          bool Balanced = false>
+class CompactBST
+{
+private:
+  static constexpr uint32_t nil = std::numeric_limits<uint32_t>::max();
+
+  struct Node
+  {
+    union
+    {
+      T data;  // constructed only while the slot is in use
+    };
+    uint32_t parent;
+    uint32_t left;  // next free slot while the slot is on the free list
+    uint32_t right;
+    bool red;
+    bool used;
+
+    Node() : parent(nil), left(nil), right(nil), red(true), used(false) {}
+    ~Node() {}
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+  Node * slots;
+  uint32_t capacity_;
+  uint32_t freeHead;
+  uint32_t root;
+  size_t size;
+  NodeAllocator alloc;
+  Compare less;
+
+  void destroySlots(Node * array, uint32_t count)
+  {
+    if (!array) return;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (array[i].used) array[i].data.~T();
+      NodeTraits::destroy(alloc, array + i);
+    }
+    NodeTraits::deallocate(alloc, array, count);
+  }
+
+  // Moves every node into a fresh array of newCapacity slots, node i going to slot map(i),
+  // and threads the remaining slots onto the free list in ascending order. Values are
+  // copied instead of moved if moving could throw, so a throw leaves the tree unchanged.
+  template <typename Map>
+  void relocate(uint32_t newCapacity, Map map)
+  {
+    auto remap = [&map](uint32_t i) { return i == nil ? nil : map(i); };
+    Node * fresh = newCapacity ? NodeTraits::allocate(alloc, newCapacity) : nullptr;
+    for (uint32_t i = 0; i < newCapacity; ++i) NodeTraits::construct(alloc, fresh + i);
+    try {
+      for (uint32_t i = 0; i < capacity_; ++i) {
+        Node & from = slots[i];
+        if (!from.used) continue;
+        Node & to = fresh[map(i)];
+        ::new (static_cast<void *>(std::addressof(to.data))) T(std::move_if_noexcept(from.data));
+        to.used = true;
+        to.red = from.red;
+        to.parent = remap(from.parent);
+        to.left = remap(from.left);
+        to.right = remap(from.right);
+      }
+    } catch (...) {
+      destroySlots(fresh, newCapacity);
+      throw;
+    }
+    destroySlots(slots, capacity_);
+    root = remap(root);
+    slots = fresh;
+    capacity_ = newCapacity;
+    freeHead = nil;
+    for (uint32_t i = newCapacity; i-- > 0;) {
+      if (slots[i].used) continue;
+      slots[i].left = freeHead;
+      freeHead = i;
+    }
+  }
+
+  void grow()
+  {
+    if (capacity_ == nil) throw std::length_error("CompactBST cannot hold 2^32 - 1 values");
+    uint32_t newCapacity = !capacity_ ? 16 : capacity_ > nil / 2 ? nil : 2 * capacity_;
+    relocate(newCapacity, [](uint32_t i) { return i; });
+  }
+
+  // Takes a slot off the free list, growing the array if there is none. Slot indices stay
+  // the same when the array grows, so indices held by the caller remain valid. The
+  // arguments may refer into the array (insert(*begin()) does), so when it has to grow the
+  // value is built first and only moved into its slot once the old array is gone.
+  template <typename... Args>
+  uint32_t createNode(Args &&... args)
+  {
+    if (freeHead == nil) {
+      T value(std::forward<Args>(args)...);
+      grow();
+      return createNode(std::move(value));
+    }
+    uint32_t i = freeHead;
+    Node & node = slots[i];
+    ::new (static_cast<void *>(std::addressof(node.data))) T(std::forward<Args>(args)...);
+    freeHead = node.left;
+    node.parent = node.left = node.right = nil;
+    node.red = true;
+    node.used = true;
+    return i;
+  }
+
+  void destroyNode(uint32_t i)
+  {
+    Node & node = slots[i];
+    node.data.~T();
+    node.used = false;
+    node.left = freeHead;
+    freeHead = i;
+  }
+
+  uint32_t getMinimumIndex(uint32_t x) const
+  {
+    while (slots[x].left != nil) x = slots[x].left;
+    return x;
+  }
+
+  uint32_t getMaximumIndex(uint32_t x) const
+  {
+    while (slots[x].right != nil) x = slots[x].right;
+    return x;
+  }
+
+  uint32_t successor(uint32_t x) const
+  {
+    if (slots[x].right != nil) return getMinimumIndex(slots[x].right);
+    uint32_t y = slots[x].parent;
+    while (y != nil && x == slots[y].right) {
+      x = y;
+      y = slots[y].parent;
+    }
+    return y;
+  }
+
+  uint32_t predecessor(uint32_t x) const
+  {
+    if (slots[x].left != nil) return getMaximumIndex(slots[x].left);
+    uint32_t y = slots[x].parent;
+    while (y != nil && x == slots[y].left) {
+      x = y;
+      y = slots[y].parent;
+    }
+    return y;
+  }
+
+  // Slot of a value equivalent to key, or nil, found the same way as by BST::findPtr
+  template <typename K>
+  uint32_t search_index(const K & key) const
+  {
+    using Order = ThreeWayOrder<T, Compare>;
+    uint32_t x = root;
+    if constexpr (Order::template applies<K>()) {
+      while (x != nil) {
+        bool below, above;
+        Order::order(less, key, slots[x].data, below, above);
+        if (!(below | above)) break;
+        x = below ? slots[x].left : slots[x].right;
+      }
+      return x;
+    } else {
+      uint32_t bound = nil;
+      while (x != nil) {
+        if (less(slots[x].data, key)) {
+          x = slots[x].right;
+        } else {
+          bound = x;
+          x = slots[x].left;
+        }
+      }
+      return bound != nil && !less(key, slots[bound].data) ? bound : nil;
+    }
+  }
+
+  void insertNode(uint32_t z)
+  {
+    uint32_t x = root;
+    uint32_t y = nil;
+    while (x != nil) {
+      y = x;
+      x = less(slots[z].data, slots[x].data) ? slots[x].left : slots[x].right;
+    }
+    slots[z].parent = y;
+    if (y == nil)
+      root = z;
+    else if (less(slots[z].data, slots[y].data))
+      slots[y].left = z;
+    else
+      slots[y].right = z;
+    ++size;
+    if constexpr (Balanced) insertFixup(z);
+  }
+
+  bool isRed(uint32_t x) const { return x != nil && slots[x].red; }
+
+  void rotateLeft(uint32_t x)
+  {
+    uint32_t y = slots[x].right;
+    slots[x].right = slots[y].left;
+    if (slots[y].left != nil) slots[slots[y].left].parent = x;
+    slots[y].parent = slots[x].parent;
+    if (slots[x].parent == nil)
+      root = y;
+    else if (x == slots[slots[x].parent].left)
+      slots[slots[x].parent].left = y;
+    else
+      slots[slots[x].parent].right = y;
+    slots[y].left = x;
+    slots[x].parent = y;
+  }
+
+  void rotateRight(uint32_t y)
+  {
+    uint32_t x = slots[y].left;
+    slots[y].left = slots[x].right;
+    if (slots[x].right != nil) slots[slots[x].right].parent = y;
+    slots[x].parent = slots[y].parent;
+    if (slots[y].parent == nil)
+      root = x;
+    else if (y == slots[slots[y].parent].left)
+      slots[slots[y].parent].left = x;
+    else
+      slots[slots[y].parent].right = x;
+    slots[x].right = y;
+    slots[y].parent = x;
+  }
+
+  // Same recolouring and rotations as BST::insertFixup
+  void insertFixup(uint32_t z)
+  {
+    while (isRed(slots[z].parent)) {
+      uint32_t p = slots[z].parent;
+      uint32_t g = slots[p].parent;
+      bool leftSide = p == slots[g].left;
+      uint32_t uncle = leftSide ? slots[g].right : slots[g].left;
+      if (isRed(uncle)) {
+        slots[p].red = slots[uncle].red = false;
+        slots[g].red = true;
+        z = g;
+        continue;
+      }
+      if (z == (leftSide ? slots[p].right : slots[p].left)) {
+        z = p;
+        leftSide ? rotateLeft(z) : rotateRight(z);
+        p = slots[z].parent;
+      }
+      slots[p].red = false;
+      slots[g].red = true;
+      leftSide ? rotateRight(g) : rotateLeft(g);
+    }
+    slots[root].red = false;
+  }
+
+  // Same as BST::deleteFixup: x (possibly nil, hence the separate parent) carries an extra
+  // black
+  void deleteFixup(uint32_t x, uint32_t parent)
+  {
+    while (x != root && !isRed(x)) {
+      bool leftSide = x == slots[parent].left;
+      uint32_t w = leftSide ? slots[parent].right : slots[parent].left;
+      if (isRed(w)) {
+        slots[w].red = false;
+        slots[parent].red = true;
+        leftSide ? rotateLeft(parent) : rotateRight(parent);
+        w = leftSide ? slots[parent].right : slots[parent].left;
+      }
+      uint32_t nearChild = leftSide ? slots[w].left : slots[w].right;
+      uint32_t farChild = leftSide ? slots[w].right : slots[w].left;
+      if (!isRed(nearChild) && !isRed(farChild)) {
+        slots[w].red = true;
+        x = parent;
+        parent = slots[x].parent;
+        continue;
+      }
+      if (!isRed(farChild)) {
+        slots[nearChild].red = false;
+        slots[w].red = true;
+        leftSide ? rotateRight(w) : rotateLeft(w);
+        w = leftSide ? slots[parent].right : slots[parent].left;
+      }
+      slots[w].red = slots[parent].red;
+      slots[parent].red = false;
+      slots[leftSide ? slots[w].right : slots[w].left].red = false;
+      leftSide ? rotateLeft(parent) : rotateRight(parent);
+      x = root;
+    }
+    if (x != nil) slots[x].red = false;
+  }
+
+  void transplant(uint32_t u, uint32_t v)
+  {
+    uint32_t p = slots[u].parent;
+    if (p == nil)
+      root = v;
+    else if (u == slots[p].left)
+      slots[p].left = v;
+    else
+      slots[p].right = v;
+    if (v != nil) slots[v].parent = p;
+  }
+
+  void eraseNode(uint32_t z)
+  {
+    uint32_t y = z;
+    bool removedRed = slots[z].red;
+    uint32_t x;
+    uint32_t xParent;
+    if (slots[z].left == nil) {
+      x = slots[z].right;
+      xParent = slots[z].parent;
+      transplant(z, x);
+    } else if (slots[z].right == nil) {
+      x = slots[z].left;
+      xParent = slots[z].parent;
+      transplant(z, x);
+    } else {
+      y = getMinimumIndex(slots[z].right);
+      removedRed = slots[y].red;
+      x = slots[y].right;
+      xParent = y;
+      if (slots[y].parent != z) {
+        xParent = slots[y].parent;
+        transplant(y, x);
+        slots[y].right = slots[z].right;
+        slots[slots[y].right].parent = y;
+      }
+      transplant(z, y);
+      slots[y].left = slots[z].left;
+      slots[slots[y].left].parent = y;
+      slots[y].red = slots[z].red;
+    }
+    destroyNode(z);
+    --size;
+    if constexpr (Balanced)
+      if (!removedRed) deleteFixup(x, xParent);
+  }
+
+  // Appends the nodes levels below x, left to right, to out without recursing, so that
+  // degenerate trees cannot exhaust the stack
+  void collectAtDepth(uint32_t x, size_t levels, std::vector<uint32_t> & out) const
+  {
+    std::vector<std::pair<uint32_t, size_t>> pending = {{x, 0}};
+    while (!pending.empty()) {
+      auto [y, depth] = pending.back();
+      pending.pop_back();
+      if (y == nil) continue;
+      if (depth == levels) {
+        out.push_back(y);
+        continue;
+      }
+      pending.push_back({slots[y].right, depth + 1});
+      pending.push_back({slots[y].left, depth + 1});
+    }
+  }
+
+  // Numbers the top levels of the subtree at x in van Emde Boas order: the upper half of
+  // the levels first, then each subtree hanging below it, each laid out the same way
+  void layoutVanEmdeBoas(uint32_t x, size_t levels, std::vector<uint32_t> & order,
+                         uint32_t & next) const
+  {
+    if (levels == 1) {
+      order[x] = next++;
+      return;
+    }
+    size_t top = levels / 2;
+    layoutVanEmdeBoas(x, top, order, next);
+    std::vector<uint32_t> bottoms;
+    collectAtDepth(x, top, bottoms);
+    for (uint32_t y : bottoms) layoutVanEmdeBoas(y, levels - top, order, next);
+  }
+
+  template <typename Value>
+  void copySlotsFrom(const CompactBST & other, Value value)
+  {
+    if (!other.capacity_) return;
+    Node * fresh = NodeTraits::allocate(alloc, other.capacity_);
+    for (uint32_t i = 0; i < other.capacity_; ++i) NodeTraits::construct(alloc, fresh + i);
+    uint32_t i = 0;
+    try {
+      for (; i < other.capacity_; ++i) {
+        Node & from = other.slots[i];
+        if (from.used)
+          ::new (static_cast<void *>(std::addressof(fresh[i].data))) T(value(from.data));
+        fresh[i].used = from.used;
+        fresh[i].red = from.red;
+        fresh[i].parent = from.parent;
+        fresh[i].left = from.left;
+        fresh[i].right = from.right;
+      }
+    } catch (...) {
+      // Slots from i on have no value yet
+      for (uint32_t j = i; j < other.capacity_; ++j) fresh[j].used = false;
+      destroySlots(fresh, other.capacity_);
+      throw;
+    }
+    slots = fresh;
+    capacity_ = other.capacity_;
+    freeHead = other.freeHead;
+    root = other.root;
+    size = other.size;
+  }
+
+  void stealFrom(CompactBST & other) noexcept
+  {
+    slots = std::exchange(other.slots, nullptr);
+    capacity_ = std::exchange(other.capacity_, 0);
+    freeHead = std::exchange(other.freeHead, nil);
+    root = std::exchange(other.root, nil);
+    size = std::exchange(other.size, 0);
+  }
+
+public:
+  class const_iterator;
+
+  using allocator_type = Allocator;
+  using key_compare = Compare;
+
+  CompactBST() : CompactBST(Compare(), Allocator()) {}
+  explicit CompactBST(const Allocator & allocator) : CompactBST(Compare(), allocator) {}
+  explicit CompactBST(const Compare & compare, const Allocator & allocator = Allocator())
+      : slots(nullptr), capacity_(0), freeHead(nil), root(nil), size(0), alloc(allocator),
+        less(compare)
+  {
+  }
+
+  CompactBST(const CompactBST & other)
+      : CompactBST(other.less,
+                   Allocator(NodeTraits::select_on_container_copy_construction(other.alloc)))
+  {
+    copySlotsFrom(other, [](const T & value) -> const T & { return value; });
+  }
+
+  CompactBST(CompactBST && other) noexcept
+      : CompactBST(other.less, Allocator(std::move(other.alloc)))
+  {
+    stealFrom(other);
+  }
+
+  CompactBST & operator=(const CompactBST & other)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) alloc = other.alloc;
+    less = other.less;
+    copySlotsFrom(other, [](const T & value) -> const T & { return value; });
+    return *this;
+  }
+
+  CompactBST & operator=(CompactBST && other) noexcept(
+    NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    clear();
+    less = other.less;
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+      alloc = std::move(other.alloc);
+      stealFrom(other);
+    } else {
+      if (alloc == other.alloc) {
+        stealFrom(other);
+      } else {
+        copySlotsFrom(other, [](T & value) -> T && { return std::move(value); });
+        other.clear();
+      }
+    }
+    return *this;
+  }
+
+  ~CompactBST() { clear(); }
+
+  allocator_type get_allocator() const { return allocator_type(alloc); }
+  key_compare key_comp() const { return less; }
+
+  // Destroys every value and releases the array
+  void clear() noexcept
+  {
+    destroySlots(slots, capacity_);
+    slots = nullptr;
+    capacity_ = 0;
+    freeHead = nil;
+    root = nil;
+    size = 0;
+  }
+
+  void insert(const T & value) { insertNode(createNode(value)); }
+  void insert(T && value) { insertNode(createNode(std::move(value))); }
+
+  template <typename... Args>
+  void emplace(Args &&... args)
+  {
+    insertNode(createNode(std::forward<Args>(args)...));
+  }
+
+  bool search(const T & data) const { return search_index(data) != nil; }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool search(const K & key) const
+  {
+    return search_index(key) != nil;
+  }
+
+  // Iterator to a value equivalent to data, or end()
+  const_iterator find(const T & data) const { return const_iterator(this, search_index(data)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K & key) const
+  {
+    return const_iterator(this, search_index(key));
+  }
+
+  void deleteNode(const T & data)
+  {
+    uint32_t z = search_index(data);
+    if (z != nil) eraseNode(z);
+  }
+
+  T getMinimum() const
+  {
+    if (empty()) throw out_of_range("Can't find minimum when empty.");
+    return slots[getMinimumIndex(root)].data;
+  }
+
+  T getMaximum() const
+  {
+    if (empty()) throw out_of_range("Can't find maximum when empty.");
+    return slots[getMaximumIndex(root)].data;
+  }
+
+  // Height of the tree in nodes (0 when empty), walked iteratively in O(n)
+  size_t getHeight() const
+  {
+    size_t height = 0;
+    std::vector<std::pair<uint32_t, size_t>> pending;
+    if (root != nil) pending.push_back({root, 1});
+    while (!pending.empty()) {
+      auto [x, depth] = pending.back();
+      pending.pop_back();
+      height = std::max(height, depth);
+      if (slots[x].left != nil) pending.push_back({slots[x].left, depth + 1});
+      if (slots[x].right != nil) pending.push_back({slots[x].right, depth + 1});
+    }
+    return height;
+  }
+
+  // Renumbers the nodes into an array of exactly getSize() slots in the given order,
+  // dropping the free list. In-order suits scans; van Emde Boas order suits lookups, as a
+  // search path of length h then spans about log(h) blocks instead of h scattered slots.
+  void compact(CompactOrder order = CompactOrder::InOrder)
+  {
+    std::vector<uint32_t> renumbered(capacity_, nil);
+    uint32_t next = 0;
+    if (root != nil) {
+      if (order == CompactOrder::InOrder) {
+        for (uint32_t x = getMinimumIndex(root); x != nil; x = successor(x)) renumbered[x] = next++;
+      } else {
+        layoutVanEmdeBoas(root, getHeight(), renumbered, next);
+      }
+    }
+    relocate(static_cast<uint32_t>(size), [&renumbered](uint32_t i) { return renumbered[i]; });
+  }
+
+  bool empty() const noexcept { return size == 0; }
+  size_t getSize() const noexcept { return size; }
+  // Slots in the array, in use or free
+  size_t capacity() const noexcept { return capacity_; }
+
+  const_iterator begin() const
+  {
+    return const_iterator(this, root == nil ? nil : getMinimumIndex(root));
+  }
+  const_iterator end() const { return const_iterator(this, nil); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  class const_iterator
+  {
+  private:
+    const CompactBST * tree;
+    uint32_t current;
+    const_iterator(const CompactBST * tree, uint32_t index) : tree(tree), current(index) {}
+    friend class CompactBST;
+
+  public:
+    const T & operator*() const { return tree->slots[current].data; }
+    const_iterator & operator++()
+    {
+      current = tree->successor(current);
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      current = tree->successor(current);
+      return temp;
+    }
+    const_iterator & operator--()
+    {
+      current = tree->predecessor(current);
+      return *this;
+    }
+    const_iterator operator--(int)
+    {
+      const_iterator temp = *this;
+      current = tree->predecessor(current);
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const { return current == other.current; }
+    bool operator!=(const const_iterator & other) const { return current != other.current; }
+  };
+};
+
+// Default B-tree order: as many children as fit 256 bytes of keys, i.e. a handful of cache
+// lines per node, kept even and at least 4.
+template <typename T>
+constexpr size_t btree_default_order = 256 / sizeof(T) < 4 ? 4 : (256 / sizeof(T)) & ~size_t(1);
+
+// B-tree with the same interface as BST. Every node holds up to Order - 1 sorted keys, so a
+// lookup touches about log_Order(n) nodes instead of log_2(n), and keys inside a node are
+// found with a branch-free linear count that the compiler can vectorise. Leaves carry no
+// child pointers at all. Keys are stored in plain arrays, so T must be default-constructible
+// and move-assignable. Like BST, duplicates are allowed. Unlike BST, keys are always ordered
+// by operator<: there is no Compare parameter and no heterogeneous lookup.
+template <typename T, size_t Order = btree_default_order<T>, typename Allocator = std::allocator<T>>
+class BTree
+{
+  static_assert(Order >= 4 && Order % 2 == 0, "BTree order must be even and at least 4");
+
+private:
+  static constexpr size_t min_degree = Order / 2;  // t: non-root nodes hold t-1 .. 2t-1 keys
+  static constexpr size_t max_keys = Order - 1;
+
+  struct Node
+  {
+    size_t count;
+    bool leaf;
+    Node * parent;
+    T keys[max_keys];
+
+    explicit Node(bool is_leaf) : count(0), leaf(is_leaf), parent(nullptr), keys() {}
+  };
+
+  struct Internal : Node
+  {
+    Node * children[Order];
+
+    Internal() : Node(false), children() {}
+  };
+
+  using LeafAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using LeafTraits = std::allocator_traits<LeafAllocator>;
+  using InternalAllocator =
+    typename std::allocator_traits<Allocator>::template rebind_alloc<Internal>;
+  using InternalTraits = std::allocator_traits<InternalAllocator>;
+
+  Node * root;
+  size_t size;
+  LeafAllocator alloc;
+
+  static Node ** children(Node * x) { return static_cast<Internal *>(x)->children; }
+  static Node * child(const Node * x, size_t i)
+  {
+    return static_cast<const Internal *>(x)->children[i];
+  }
+
+  Node * createNode(bool leaf)
+  {
+    if (leaf) {
+      Node * node = LeafTraits::allocate(alloc, 1);
+      try {
+        LeafTraits::construct(alloc, node, true);
+      } catch (...) {
+        LeafTraits::deallocate(alloc, node, 1);
+        throw;
+      }
+      return node;
+    }
+    InternalAllocator internalAlloc(alloc);
+    Internal * node = InternalTraits::allocate(internalAlloc, 1);
+    try {
+      InternalTraits::construct(internalAlloc, node);
+    } catch (...) {
+      InternalTraits::deallocate(internalAlloc, node, 1);
+      throw;
+    }
+    return node;
+  }
+
+  void destroyNode(Node * node)
+  {
+    if (node->leaf) {
+      LeafTraits::destroy(alloc, node);
+      LeafTraits::deallocate(alloc, node, 1);
+    } else {
+      InternalAllocator internalAlloc(alloc);
+      Internal * internal = static_cast<Internal *>(node);
+      InternalTraits::destroy(internalAlloc, internal);
+      InternalTraits::deallocate(internalAlloc, internal, 1);
+    }
+  }
+
+  void destroyTree(Node * x)
+  {
+    if (!x) return;
+    if (!x->leaf)
+      for (size_t i = 0; i <= x->count; ++i) destroyTree(child(x, i));
+    destroyNode(x);
+  }
+
+  // Number of keys in x less than k (first position not less than k)
+  static size_t lowerIndex(const Node * x, const T & k)
+  {
+    size_t i = 0;
+    for (size_t j = 0; j < x->count; ++j) i += x->keys[j] < k;
+    return i;
+  }
+
+  // Number of keys in x not greater than k (first position greater than k)
+  static size_t upperIndex(const Node * x, const T & k)
+  {
+    size_t i = 0;
+    for (size_t j = 0; j < x->count; ++j) i += !(k < x->keys[j]);
+    return i;
+  }
+
+  static size_t indexInParent(const Node * x)
+  {
+    const Node * p = x->parent;
+    size_t i = 0;
+    while (child(p, i) != x) ++i;
+    return i;
+  }
+
+  static void setChild(Node * x, size_t i, Node * c)
+  {
+    children(x)[i] = c;
+    c->parent = x;
+  }
+
+  // Splits the full child i of x around its median, which moves up into x
+  void splitChild(Node * x, size_t i)
+  {
+    Node * y = child(x, i);
+    Node * z = createNode(y->leaf);
+    const size_t t = min_degree;
+    for (size_t j = 0; j < t - 1; ++j) z->keys[j] = std::move(y->keys[j + t]);
+    if (!y->leaf)
+      for (size_t j = 0; j < t; ++j) setChild(z, j, child(y, j + t));
+    z->count = t - 1;
+    y->count = t - 1;
+
+    for (size_t j = x->count; j > i; --j) children(x)[j + 1] = child(x, j);
+    setChild(x, i + 1, z);
+    for (size_t j = x->count; j > i; --j) x->keys[j] = std::move(x->keys[j - 1]);
+    x->keys[i] = std::move(y->keys[t - 1]);
+    ++x->count;
+  }
+
+  // Folds key i of x and child i + 1 into child i; both children hold t - 1 keys
+  void mergeChildren(Node * x, size_t i)
+  {
+    Node * y = child(x, i);
+    Node * z = child(x, i + 1);
+    y->keys[y->count] = std::move(x->keys[i]);
+    for (size_t j = 0; j < z->count; ++j) y->keys[y->count + 1 + j] = std::move(z->keys[j]);
+    if (!y->leaf)
+      for (size_t j = 0; j <= z->count; ++j) setChild(y, y->count + 1 + j, child(z, j));
+    y->count += z->count + 1;
+
+    for (size_t j = i; j + 1 < x->count; ++j) x->keys[j] = std::move(x->keys[j + 1]);
+    for (size_t j = i + 1; j < x->count; ++j) children(x)[j] = child(x, j + 1);
+    --x->count;
+    destroyNode(z);
+  }
+
+  // Makes sure child i of x has at least t keys before descending into it, borrowing from
+  // a sibling or merging with one. Returns the index of the child to descend into.
+  size_t fillChild(Node * x, size_t i)
+  {
+    Node * c = child(x, i);
+    if (c->count >= min_degree) return i;
+    if (i > 0 && child(x, i - 1)->count >= min_degree) {
+      Node * left = child(x, i - 1);
+      for (size_t j = c->count; j > 0; --j) c->keys[j] = std::move(c->keys[j - 1]);
+      c->keys[0] = std::move(x->keys[i - 1]);
+      x->keys[i - 1] = std::move(left->keys[left->count - 1]);
+      if (!c->leaf) {
+        for (size_t j = c->count + 1; j > 0; --j) children(c)[j] = child(c, j - 1);
+        setChild(c, 0, child(left, left->count));
+      }
+      ++c->count;
+      --left->count;
+      return i;
+    }
+    if (i < x->count && child(x, i + 1)->count >= min_degree) {
+      Node * right = child(x, i + 1);
+      c->keys[c->count] = std::move(x->keys[i]);
+      x->keys[i] = std::move(right->keys[0]);
+      for (size_t j = 0; j + 1 < right->count; ++j)
+        right->keys[j] = std::move(right->keys[j + 1]);
+      if (!c->leaf) {
+        setChild(c, c->count + 1, child(right, 0));
+        for (size_t j = 0; j < right->count; ++j) children(right)[j] = child(right, j + 1);
+      }
+      ++c->count;
+      --right->count;
+      return i;
+    }
+    if (i < x->count) {
+      mergeChildren(x, i);
+      return i;
+    }
+    mergeChildren(x, i - 1);
+    return i - 1;
+  }
+
+  template <typename U>
+  void insertValue(U && value)
+  {
+    // splitChild moves keys around before value is stored, so a value naming a key of this
+    // tree is copied out first
+    if constexpr (std::is_lvalue_reference_v<U>) {
+      T copy(value);
+      insertValue(std::move(copy));
+      return;
+    }
+    if (!root) {
+      root = createNode(true);
+      root->keys[0] = std::forward<U>(value);
+      root->count = 1;
+      ++size;
+      return;
+    }
+    if (root->count == max_keys) {
+      Node * s = createNode(false);
+      setChild(s, 0, root);
+      root = s;
+      splitChild(s, 0);
+    }
+    Node * x = root;
+    while (!x->leaf) {
+      size_t i = upperIndex(x, value);
+      if (child(x, i)->count == max_keys) {
+        splitChild(x, i);
+        if (!(value < x->keys[i])) ++i;
+      }
+      x = child(x, i);
+    }
+    size_t i = upperIndex(x, value);
+    for (size_t j = x->count; j > i; --j) x->keys[j] = std::move(x->keys[j - 1]);
+    x->keys[i] = std::forward<U>(value);
+    ++x->count;
+    ++size;
+  }
+
+  // Removes one key equal to k from the subtree rooted at x, which (unless it is the root)
+  // holds at least t keys on entry.
+  bool eraseFrom(Node * x, const T & k)
+  {
+    while (true) {
+      size_t i = lowerIndex(x, k);
+      bool found = i < x->count && !(k < x->keys[i]);
+      if (found && x->leaf) {
+        for (size_t j = i; j + 1 < x->count; ++j) x->keys[j] = std::move(x->keys[j + 1]);
+        --x->count;
+        return true;
+      }
+      if (found) {
+        Node * y = child(x, i);
+        Node * z = child(x, i + 1);
+        if (y->count >= min_degree) {
+          Node * m = y;
+          while (!m->leaf) m = child(m, m->count);
+          x->keys[i] = m->keys[m->count - 1];
+          return eraseFrom(y, x->keys[i]);
+        }
+        if (z->count >= min_degree) {
+          Node * m = z;
+          while (!m->leaf) m = child(m, 0);
+          x->keys[i] = m->keys[0];
+          return eraseFrom(z, x->keys[i]);
+        }
+        mergeChildren(x, i);
+        x = y;
+        continue;
+      }
+      if (x->leaf) return false;
+      x = child(x, fillChild(x, i));
+    }
+  }
+
+  void shrinkRoot()
+  {
+    if (root->count) return;
+    Node * old = root;
+    if (root->leaf) {
+      root = nullptr;
+    } else {
+      root = child(root, 0);
+      root->parent = nullptr;
+    }
+    destroyNode(old);
+  }
+
+  Node * cloneTree(const Node * src, Node * parent)
+  {
+    Node * x = createNode(src->leaf);
+    x->parent = parent;
+    try {
+      for (size_t j = 0; j < src->count; ++j) x->keys[j] = src->keys[j];
+      x->count = src->count;
+      if (!src->leaf) {
+        size_t built = 0;
+        try {
+          for (; built <= src->count; ++built)
+            children(x)[built] = cloneTree(child(src, built), x);
+        } catch (...) {
+          for (size_t j = 0; j < built; ++j) destroyTree(child(x, j));
+          throw;
+        }
+      }
+    } catch (...) {
+      destroyNode(x);
+      throw;
+    }
+    return x;
+  }
+
+  static const Node * leftmostLeaf(const Node * x)
+  {
+    while (!x->leaf) x = child(x, 0);
+    return x;
+  }
+
+  static const Node * rightmostLeaf(const Node * x)
+  {
+    while (!x->leaf) x = child(x, x->count);
+    return x;
+  }
+
+  static void successor(const Node *& x, size_t & i)
+  {
+    if (!x->leaf) {
+      x = leftmostLeaf(child(x, i + 1));
+      i = 0;
+      return;
+    }
+    if (++i < x->count) return;
+    while (x->parent) {
+      size_t ci = indexInParent(x);
+      x = x->parent;
+      if (ci < x->count) {
+        i = ci;
+        return;
+      }
+    }
+    x = nullptr;
+    i = 0;
+  }
+
+  static void predecessor(const Node *& x, size_t & i)
+  {
+    if (!x->leaf) {
+      x = rightmostLeaf(child(x, i));
+      i = x->count - 1;
+      return;
+    }
+    if (i > 0) {
+      --i;
+      return;
+    }
+    while (x->parent) {
+      size_t ci = indexInParent(x);
+      x = x->parent;
+      if (ci > 0) {
+        i = ci - 1;
+        return;
+      }
+    }
+    x = nullptr;
+    i = 0;
+  }
+
+public:
+  class iterator;
+  class const_iterator;
+
+  using allocator_type = Allocator;
+
+  static constexpr size_t order = Order;
+
+  BTree() : BTree(Allocator()) {}
+  explicit BTree(const Allocator & allocator) : root(nullptr), size(0), alloc(allocator) {}
+
+  BTree(const BTree & other)
+      : BTree(Allocator(LeafTraits::select_on_container_copy_construction(other.alloc)))
+  {
+    if (other.root) root = cloneTree(other.root, nullptr);
+    size = other.size;
+  }
+
+  BTree(BTree && other) noexcept
+      : root(other.root), size(other.size), alloc(std::move(other.alloc))
+  {
+    other.root = nullptr;
+    other.size = 0;
+  }
+
+  BTree & operator=(const BTree & other)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (LeafTraits::propagate_on_container_copy_assignment::value) alloc = other.alloc;
+    if (other.root) root = cloneTree(other.root, nullptr);
+    size = other.size;
+    return *this;
+  }
+
+  BTree & operator=(BTree && other) noexcept(
+    LeafTraits::propagate_on_container_move_assignment::value || LeafTraits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    clear();
+    if constexpr (LeafTraits::propagate_on_container_move_assignment::value)
+      alloc = std::move(other.alloc);
+    if (LeafTraits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+      root = other.root;
+      size = other.size;
+      other.root = nullptr;
+    } else {
+      if (other.root) root = cloneTree(other.root, nullptr);
+      size = other.size;
+      other.clear();
+    }
+    other.size = 0;
+    return *this;
+  }
+
+  ~BTree() { clear(); }
+
+  allocator_type get_allocator() const { return allocator_type(alloc); }
+
+  size_t getSize() const { return size; }
+  bool empty() const { return !size; }
+
+  // Number of levels (0 when empty); every leaf sits on the last one
+  size_t getHeight() const
+  {
+    size_t height = 0;
+    for (const Node * x = root; x; x = x->leaf ? nullptr : child(x, 0)) ++height;
+    return height;
+  }
+
+  void clear() noexcept
+  {
+    destroyTree(root);
+    root = nullptr;
+    size = 0;
+  }
+
+  void insert(const T & data) { insertValue(data); }
+  void insert(T && data) { insertValue(std::move(data)); }
+
+  void deleteNode(const T & data)
+  {
+    if (!root) return;
+    // fillChild and mergeChildren move keys on the way down, so data may name one of them
+    T key(data);
+    if (eraseFrom(root, key)) --size;
+    shrinkRoot();
+  }
+
+  bool search(const T & data) const
+  {
+    const Node * x = root;
+    while (x) {
+      size_t i = lowerIndex(x, data);
+      if (i < x->count && !(data < x->keys[i])) return true;
+      x = x->leaf ? nullptr : child(x, i);
+    }
+    return false;
+  }
+
+  T getMinimum() const
+  {
+    if (empty()) throw out_of_range("Can't find minimum when empty.");
+    return leftmostLeaf(root)->keys[0];
+  }
+
+  T getMaximum() const
+  {
+    if (empty()) throw out_of_range("Can't find maximum when empty.");
+    const Node * x = rightmostLeaf(root);
+    return x->keys[x->count - 1];
+  }
+
+  iterator begin()
+  {
+    return iterator(root ? const_cast<Node *>(leftmostLeaf(root)) : nullptr, 0);
+  }
+  iterator end() { return iterator(nullptr, 0); }
+  const_iterator cbegin() const { return const_iterator(root ? leftmostLeaf(root) : nullptr, 0); }
+  const_iterator cend() const { return const_iterator(nullptr, 0); }
+
+  // Keys must not be modified in a way that changes their order
+  class iterator
+  {
+  private:
+    Node * current;
+    size_t index;
+    iterator(Node * node, size_t i) : current(node), index(i) {}
+    friend class BTree;
+
+    void step(void (*move)(const Node *&, size_t &))
+    {
+      const Node * node = current;
+      move(node, index);
+      current = const_cast<Node *>(node);
+    }
+
+  public:
+    T & operator*() { return current->keys[index]; }
+    iterator & operator++()
+    {
+      step(successor);
+      return *this;
+    }
+    iterator operator++(int)
+    {
+      iterator temp = *this;
+      step(successor);
+      return temp;
+    }
+    iterator & operator--()
+    {
+      step(predecessor);
+      return *this;
+    }
+    iterator operator--(int)
+    {
+      iterator temp = *this;
+      step(predecessor);
+      return temp;
+    }
+    bool operator==(const iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const iterator & other) const { return !(*this == other); }
+  };
+
+  class const_iterator
+  {
+  private:
+    const Node * current;
+    size_t index;
+    const_iterator(const Node * node, size_t i) : current(node), index(i) {}
+    friend class BTree;
+
+  public:
+    const T & operator*() const { return current->keys[index]; }
+    const_iterator & operator++()
+    {
+      successor(current, index);
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      successor(current, index);
+      return temp;
+    }
+    const_iterator & operator--()
+    {
+      predecessor(current, index);
+      return *this;
+    }
+    const_iterator operator--(int)
+    {
+      const_iterator temp = *this;
+      predecessor(current, index);
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const
+    {
+      return current == other.current && index == other.index;
+    }
+    bool operator!=(const const_iterator & other) const { return !(*this == other); }
+  };
+};
+
+// Persistent (path-copying) AVL tree for one writer and any number of concurrent readers.
+// Nodes are immutable once published: insert and deleteNode copy only the O(log n) nodes on
+// the path they change and share the rest with older versions, then publish the new root
+// with a single atomic store. Readers never lock and never block the writer. search() runs
+// inside an EpochGuard without touching any reference count, and snapshot() hands out a
+// reference-counted version that stays valid, unchanged, for as long as it is held. Replaced
+// versions are retired through EpochReclaimer and their nodes are freed with the last
+// snapshot sharing them. Mutating calls must not overlap; readers may run at any time.
+// Values are ordered by operator<; unlike BST there is no Compare parameter.
+template <typename T>
+class PersistentBST
+{
+private:
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+  struct Node
+  {
+    T data;
+    NodePtr left;
+    NodePtr right;
+    size_t height;
+
+    template <typename U>
+    Node(U && data, NodePtr left, NodePtr right)
+        : data(std::forward<U>(data)),
+          left(std::move(left)),
+          right(std::move(right)),
+          height(1 + std::max(heightOf(this->left), heightOf(this->right)))
+    {
+    }
+  };
+
+  struct Version
+  {
+    NodePtr root;
+    size_t size;
+  };
+
+  std::atomic<Version *> current;
+
+  static void deleteVersion(void * p) { delete static_cast<Version *>(p); }
+
+  static size_t heightOf(const NodePtr & x) { return x ? x->height : 0; }
+
+  template <typename U>
+  static NodePtr makeNode(U && data, NodePtr left, NodePtr right)
+  {
+    return std::make_shared<const Node>(std::forward<U>(data), std::move(left), std::move(right));
+  }
+
+  // New node over left and right, rotated once or twice if their heights differ by two
+  static NodePtr balance(const T & data, NodePtr left, NodePtr right)
+  {
+    size_t hl = heightOf(left);
+    size_t hr = heightOf(right);
+    if (hl > hr + 1) {
+      if (heightOf(left->left) >= heightOf(left->right))
+        return makeNode(left->data, left->left, makeNode(data, left->right, std::move(right)));
+      const Node * lr = left->right.get();
+      return makeNode(lr->data, makeNode(left->data, left->left, lr->left),
+                      makeNode(data, lr->right, std::move(right)));
+    }
+    if (hr > hl + 1) {
+      if (heightOf(right->right) >= heightOf(right->left))
+        return makeNode(right->data, makeNode(data, std::move(left), right->left), right->right);
+      const Node * rl = right->left.get();
+      return makeNode(rl->data, makeNode(data, std::move(left), rl->left),
+                      makeNode(right->data, rl->right, right->right));
+    }
+    return makeNode(data, std::move(left), std::move(right));
+  }
+
+  // Equal values go to the right, as in BST
+  template <typename U>
+  static NodePtr insertAt(const NodePtr & x, U && data)
+  {
+    if (!x) return makeNode(std::forward<U>(data), nullptr, nullptr);
+    if (data < x->data) return balance(x->data, insertAt(x->left, std::forward<U>(data)), x->right);
+    return balance(x->data, x->left, insertAt(x->right, std::forward<U>(data)));
+  }
+
+  // Removes the leftmost node below x; min is pointed at it (it stays alive through x)
+  static NodePtr eraseMinimum(const NodePtr & x, const Node *& min)
+  {
+    if (!x->left) {
+      min = x.get();
+      return x->right;
+    }
+    return balance(x->data, eraseMinimum(x->left, min), x->right);
+  }
+
+  // Returns x unchanged, with erased left false, when data is not below x
+  static NodePtr eraseAt(const NodePtr & x, const T & data, bool & erased)
+  {
+    if (!x) return x;
+    if (data < x->data) {
+      NodePtr left = eraseAt(x->left, data, erased);
+      return erased ? balance(x->data, std::move(left), x->right) : x;
+    }
+    if (x->data < data) {
+      NodePtr right = eraseAt(x->right, data, erased);
+      return erased ? balance(x->data, x->left, std::move(right)) : x;
+    }
+    erased = true;
+    if (!x->left) return x->right;
+    if (!x->right) return x->left;
+    const Node * min = nullptr;
+    NodePtr right = eraseMinimum(x->right, min);
+    return balance(min->data, x->left, std::move(right));
+  }
+
+  // Makes root the current version; the old one is freed once no reader can still see it
+  void publish(NodePtr root, size_t size)
+  {
+    Version * old = current.exchange(new Version{std::move(root), size});
+    EpochReclaimer::instance().retire(old, deleteVersion);
+  }
+
+  // Only the writer calls this, so the version cannot be retired underneath it
+  const Version & latest() const { return *current.load(std::memory_order_relaxed); }
+
+public:
+  class Snapshot;
+  class const_iterator;
+
+  PersistentBST() : current(new Version{nullptr, 0}) {}
+  PersistentBST(const PersistentBST &) = delete;
+  PersistentBST & operator=(const PersistentBST &) = delete;
+
+  // No reader may be running; versions already retired free themselves independently
+  ~PersistentBST() { delete current.load(); }
+
+  size_t getSize() const
+  {
+    EpochGuard guard;
+    return current.load(std::memory_order_acquire)->size;
+  }
+  bool empty() const { return !getSize(); }
+
+  void insert(const T & data) { publish(insertAt(latest().root, data), latest().size + 1); }
+  void insert(T && data) { publish(insertAt(latest().root, std::move(data)), latest().size + 1); }
+
+  void deleteNode(const T & data)
+  {
+    bool erased = false;
+    NodePtr root = eraseAt(latest().root, data, erased);
+    if (erased) publish(std::move(root), latest().size - 1);
+  }
+
+  void clear() { publish(nullptr, 0); }
+
+  // Lookup against the latest version without taking a reference to it
+  bool search(const T & data) const
+  {
+    EpochGuard guard;
+    const Node * x = current.load(std::memory_order_acquire)->root.get();
+    while (x) {
+      if (data < x->data)
+        x = x->left.get();
+      else if (x->data < data)
+        x = x->right.get();
+      else
+        return true;
+    }
+    return false;
+  }
+
+  // Consistent read-only view of the tree as it is now; later writes do not affect it
+  Snapshot snapshot() const
+  {
+    EpochGuard guard;
+    const Version * v = current.load(std::memory_order_acquire);
+    return Snapshot(v->root, v->size);
+  }
+
+  class Snapshot
+  {
+  private:
+    NodePtr root;
+    size_t size;
+    Snapshot(NodePtr root, size_t size) : root(std::move(root)), size(size) {}
+    friend class PersistentBST;
+
+  public:
+    Snapshot() : root(nullptr), size(0) {}
+
+    size_t getSize() const { return size; }
+    bool empty() const { return !size; }
+    size_t getHeight() const { return heightOf(root); }
+
+    bool search(const T & data) const
+    {
+      const Node * x = root.get();
+      while (x) {
+        if (data < x->data)
+          x = x->left.get();
+        else if (x->data < data)
+          x = x->right.get();
+        else
+          return true;
+      }
+      return false;
+    }
+
+    T getMinimum() const
+    {
+      if (empty()) throw out_of_range("Can't find minimum when empty.");
+      const Node * x = root.get();
+      while (x->left) x = x->left.get();
+      return x->data;
+    }
+
+    T getMaximum() const
+    {
+      if (empty()) throw out_of_range("Can't find maximum when empty.");
+      const Node * x = root.get();
+      while (x->right) x = x->right.get();
+      return x->data;
+    }
+
+    const_iterator begin() const { return const_iterator(root.get()); }
+    const_iterator end() const { return const_iterator(); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+  };
+
+  // Forward in-order iterator over a Snapshot. Nodes have no parent links (they are shared
+  // between versions), so the iterator keeps the path of ancestors still to be visited.
+  class const_iterator
+  {
+  private:
+    std::vector<const Node *> path;  // back() is the current node
+    const_iterator() = default;
+    explicit const_iterator(const Node * x) { pushLeft(x); }
+    friend class Snapshot;
+
+    void pushLeft(const Node * x)
+    {
+      for (; x; x = x->left.get()) path.push_back(x);
+    }
+
+  public:
+    const T & operator*() const { return path.back()->data; }
+    const_iterator & operator++()
+    {
+      const Node * x = path.back();
+      path.pop_back();
+      pushLeft(x->right.get());
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator temp = *this;
+      ++*this;
+      return temp;
+    }
+    bool operator==(const const_iterator & other) const
+    {
+      if (path.empty() || other.path.empty()) return path.empty() == other.path.empty();
+      return path.back() == other.path.back();
+    }
+    bool operator!=(const const_iterator & other) const { return !(*this == other); }
+  };
+};
+
+// Addressable d-ary min-heap: top() is an element that no other element compares less than
+// under Compare. The heap lives in one contiguous array, and D children per node (4 by
+// default) keep it shallow while the children of a node share a cache line or two. push
+// returns a handle that stays valid while its element is in the queue, whatever moves the
+// heap makes, and can be used to decrease_key, update or erase that element.
+template <typename T, typename Compare = std::less<T>, size_t D = 4>
+class PriorityQueue
+{
+  static_assert(D >= 2, "A heap needs at least two children per node.");
+
+private:
+  struct Entry
+  {
+    T value;
+    size_t slot;  // index into positions; what a handle refers to
+  };
+
+  std::vector<Entry> heap;
+  std::vector<size_t> positions;   // heap index of the element owning each slot
+  std::vector<size_t> free_slots;  // slots of elements that have left the queue
+  Compare less;
+
+  static size_t parentOf(size_t i) { return (i - 1) / D; }
+  static size_t firstChildOf(size_t i) { return D * i + 1; }
+
+  size_t claimSlot()
+  {
+    if (free_slots.empty()) {
+      positions.push_back(0);
+      return positions.size() - 1;
+    }
+    size_t slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+  }
+
+  void place(size_t i, Entry && entry)
+  {
+    positions[entry.slot] = i;
+    heap[i] = std::move(entry);
+  }
+
+  // Moves heap[i] up past every ancestor it compares less than, shifting the ancestors
+  // down into the hole rather than swapping at each level
+  void siftUp(size_t i)
+  {
+    Entry entry = std::move(heap[i]);
+    while (i > 0) {
+      size_t parent = parentOf(i);
+      if (!less(entry.value, heap[parent].value)) break;
+      place(i, std::move(heap[parent]));
+      i = parent;
+    }
+    place(i, std::move(entry));
+  }
+
+  void siftDown(size_t i)
+  {
+    Entry entry = std::move(heap[i]);
+    size_t n = heap.size();
+    while (true) {
+      size_t first = firstChildOf(i);
+      if (first >= n) break;
+      size_t last = std::min(first + D, n);
+      size_t best = first;
+      for (size_t c = first + 1; c < last; ++c)
+        if (less(heap[c].value, heap[best].value)) best = c;
+      if (!less(heap[best].value, entry.value)) break;
+      place(i, std::move(heap[best]));
+      i = best;
+    }
+    place(i, std::move(entry));
+  }
+
+  // Removes the element at heap index i, filling the hole with the last element
+  void removeAt(size_t i)
+  {
+    free_slots.push_back(heap[i].slot);
+    size_t last = heap.size() - 1;
+    if (i != last) {
+      place(i, std::move(heap[last]));
+      heap.pop_back();
+      if (i > 0 && less(heap[i].value, heap[parentOf(i)].value))
+        siftUp(i);
+      else
+        siftDown(i);
+    } else {
+      heap.pop_back();
+    }
+  }
+
+  // Floyd's bottom-up construction: sifting down every internal node from the last one up
+  // builds the heap in O(n)
+  void heapify()
+  {
+    if (heap.size() < 2) return;
+    for (size_t i = parentOf(heap.size() - 1) + 1; i-- > 0;) siftDown(i);
+  }
+
+public:
+  class handle
+  {
+  private:
+    size_t slot;
+    explicit handle(size_t slot) : slot(slot) {}
+    friend class PriorityQueue;
+
+  public:
+    handle() : slot(size_t(-1)) {}
+    bool operator==(const handle & other) const { return slot == other.slot; }
+    bool operator!=(const handle & other) const { return slot != other.slot; }
+  };
+
+  explicit PriorityQueue(const Compare & compare = Compare()) : less(compare) {}
+
+  template <typename InputIt>
+  PriorityQueue(InputIt first, InputIt last, const Compare & compare = Compare()) : less(compare)
+  {
+    assign(first, last);
+  }
+
+  size_t getSize() const { return heap.size(); }
+  bool empty() const { return heap.empty(); }
+
+  void clear() noexcept
+  {
+    heap.clear();
+    positions.clear();
+    free_slots.clear();
+  }
+
+  // Replaces the contents with the values in [first, last) in O(n). The i-th value of the
+  // range gets handles[i] in the second overload.
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last)
+  {
+    clear();
+    try {
+      for (; first != last; ++first) heap.push_back({*first, heap.size()});
+      positions.resize(heap.size());
+    } catch (...) {
+      clear();
+      throw;
+    }
+    for (size_t i = 0; i < heap.size(); ++i) positions[i] = i;
+    heapify();
+  }
+
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last, std::vector<handle> & handles)
+  {
+    assign(first, last);
+    handles.clear();
+    handles.reserve(heap.size());
+    for (size_t slot = 0; slot < heap.size(); ++slot) handles.push_back(handle(slot));
+  }
+
+  handle push(const T & value) { return emplace(value); }
+  handle push(T && value) { return emplace(std::move(value)); }
+
+  template <typename... Args>
+  handle emplace(Args &&... args)
+  {
+    size_t slot = claimSlot();
+    try {
+      heap.push_back({T(std::forward<Args>(args)...), slot});
+    } catch (...) {
+      free_slots.push_back(slot);
+      throw;
+    }
+    positions[slot] = heap.size() - 1;
+    siftUp(heap.size() - 1);
+    return handle(slot);
+  }
+
+  const T & top() const
+  {
+    if (empty()) throw out_of_range("Can't access top when empty.");
+    return heap.front().value;
+  }
+
+  // Handle of the element top() returns
+  handle top_handle() const
+  {
+    if (empty()) throw out_of_range("Can't access top when empty.");
+    return handle(heap.front().slot);
+  }
+
+  void pop()
+  {
+    if (empty()) throw out_of_range("Cannot pop from empty queue");
+    removeAt(0);
+  }
+
+  // Moves the top element into out and removes it
+  void pop(T & out)
+  {
+    if (empty()) throw out_of_range("Cannot pop from empty queue");
+    out = std::move(heap.front().value);
+    removeAt(0);
+  }
+
+  // Value of the element h refers to; h must belong to an element still in the queue
+  const T & get(handle h) const { return heap[positions[h.slot]].value; }
+
+  // Replaces the value of h's element with one that does not compare greater, in O(log n)
+  void decrease_key(handle h, const T & value)
+  {
+    size_t i = positions[h.slot];
+    heap[i].value = value;
+    siftUp(i);
+  }
+
+  // Replaces the value of h's element with any value and restores the heap order
+  void update(handle h, const T & value)
+  {
+    size_t i = positions[h.slot];
+    bool smaller = less(value, heap[i].value);
+    heap[i].value = value;
+    if (smaller)
+      siftUp(i);
+    else
+      siftDown(i);
+  }
+
+  // Removes h's element from the queue; h and any copies of it become invalid
+  void erase(handle h) { removeAt(positions[h.slot]); }
+};
+
+// Relaxed concurrent priority queue (MultiQueue). Elements are spread over c * P shards,
+// each a PriorityQueue behind its own mutex, for P threads and a small factor c. push
+// locks one random shard; try_pop locks two random shards and pops the smaller of their
+// tops. Locks are only ever tried, never waited for: a busy shard is skipped in favour of
+// another random one, so threads rarely contend. The order is approximate: a popped
+// element is among the O(c * P) smallest with high probability, not always the smallest.
+template <typename T, typename Compare = std::less<T>>
+class MultiQueue
+{
+private:
+  // Each shard on its own cache lines, so locking one does not slow down its neighbours
+  struct alignas(64) Shard
+  {
+    std::mutex mutex;
+    PriorityQueue<T, Compare> heap;
+
+    explicit Shard(const Compare & compare) : heap(compare) {}
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  Compare less;
+
+  // Per-thread xorshift generator; quality hardly matters, speed and independence do
+  static std::uint64_t nextRandom()
+  {
+    thread_local std::uint64_t state =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  Shard & randomShard() { return *shards[nextRandom() % shards.size()]; }
+
+  // Fallback for when random picks keep finding empty shards: looks at every shard in turn,
+  // waiting for each lock, so it only reports nothing when every shard was seen empty
+  bool popFromAny(T & out)
+  {
+    for (auto & shard : shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      if (!shard->heap.empty()) {
+        shard->heap.pop(out);
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  // threads is the number of threads expected to use the queue and factor the number of
+  // shards per thread
+  explicit MultiQueue(size_t threads = std::thread::hardware_concurrency(), size_t factor = 2,
+                      const Compare & compare = Compare())
+      : less(compare)
+  {
+    size_t count = std::max<size_t>(2, std::max<size_t>(1, threads) * factor);
+    shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) shards.push_back(std::make_unique<Shard>(compare));
+  }
+
+  MultiQueue(const MultiQueue &) = delete;
+  MultiQueue & operator=(const MultiQueue &) = delete;
+
+  size_t shardCount() const { return shards.size(); }
+
+  void push(const T & value) { emplace(value); }
+  void push(T && value) { emplace(std::move(value)); }
+
+  template <typename... Args>
+  void emplace(Args &&... args)
+  {
+    while (true) {
+      Shard & shard = randomShard();
+      std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+      if (!lock) continue;
+      shard.heap.emplace(std::forward<Args>(args)...);
+      return;
+    }
+  }
+
+  // Pops a small element into out, or returns false if the queue was found empty
+  bool try_pop(T & out)
+  {
+    // Two random shards that both turn out empty suggest a (nearly) empty queue; after a
+    // few such draws, stop guessing and check every shard
+    for (size_t emptyDraws = 0; emptyDraws < 4;) {
+      size_t i = nextRandom() % shards.size();
+      size_t j = (i + 1 + nextRandom() % (shards.size() - 1)) % shards.size();
+      Shard & first = *shards[i];
+      Shard & second = *shards[j];
+      std::unique_lock<std::mutex> firstLock(first.mutex, std::try_to_lock);
+      if (!firstLock) continue;
+      std::unique_lock<std::mutex> secondLock(second.mutex, std::try_to_lock);
+      if (!secondLock) continue;
+
+      Shard * best = &first;
+      if (first.heap.empty() || (!second.heap.empty() &&
+                                 less(second.heap.top(), first.heap.top())))
+        best = &second;
+      if (best->heap.empty()) {
+        ++emptyDraws;
+        continue;
+      }
+      best->heap.pop(out);
+      return true;
+    }
+    return popFromAny(out);
+  }
+
+  // Whether every shard was empty when looked at; only exact while no thread is pushing
+  bool empty()
+  {
+    for (auto & shard : shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      if (!shard->heap.empty()) return false;
+    }
+    return true;
+  }
+};
+
+// Radix heap for unsigned integer keys that are monotone: no key pushed may be below the
+// key popped last, unless the heap is empty. Bucket 0 holds keys equal to the last popped
+// key and bucket i > 0 the keys whose highest bit differing from it is bit i - 1. When
+// bucket 0 runs dry, the first non-empty bucket is spread over the lower ones around its
+// minimum, so each element moves down at most once per bit: O(1) push and amortized
+// O(log C) pop, C the key range.
+template <typename Key, typename Value>
+class RadixHeap
+{
+  static_assert(std::is_unsigned_v<Key>, "RadixHeap keys must be unsigned integers.");
+
+private:
+  static constexpr size_t bucket_count = std::numeric_limits<Key>::digits + 1;
+
+  std::vector<std::pair<Key, Value>> buckets[bucket_count];
+  Key last;
+  size_t size;
+
+  size_t bucketOf(Key key) const
+  {
+    if (key == last) return 0;
+    return 64 - countLeadingZeros(static_cast<std::uint64_t>(key ^ last));
+  }
+
+  void refill()
+  {
+    size_t i = 1;
+    while (buckets[i].empty()) ++i;
+    Key smallest = buckets[i].front().first;
+    for (const auto & entry : buckets[i]) smallest = std::min(smallest, entry.first);
+    last = smallest;
+    for (auto & entry : buckets[i]) buckets[bucketOf(entry.first)].push_back(std::move(entry));
+    buckets[i].clear();
+  }
+
+public:
+  RadixHeap() : last(0), size(0) {}
+
+  size_t getSize() const { return size; }
+  bool empty() const { return !size; }
+
+  // Key below which nothing may be pushed
+  Key lastKey() const { return last; }
+
+  void push(Key key, const Value & value) { emplace(key, value); }
+  void push(Key key, Value && value) { emplace(key, std::move(value)); }
+
+  template <typename... Args>
+  void emplace(Key key, Args &&... args)
+  {
+    if (key < last) {
+      if (size) throw out_of_range("Key is below the last popped key.");
+      last = key;  // nothing queued to stay consistent with
+    }
+    buckets[bucketOf(key)].emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                                        std::forward_as_tuple(std::forward<Args>(args)...));
+    ++size;
+  }
+
+  // Moves an entry with the smallest key into key and value and removes it
+  void pop(Key & key, Value & value)
+  {
+    if (empty()) throw out_of_range("Cannot pop from empty queue");
+    if (buckets[0].empty()) refill();
+    key = buckets[0].back().first;
+    value = std::move(buckets[0].back().second);
+    buckets[0].pop_back();
+    --size;
+  }
+
+  void clear() noexcept
+  {
+    for (auto & bucket : buckets) bucket.clear();
+    last = 0;
+    size = 0;
+  }
+};
+
+// Bucket (Dial) queue for unsigned integer keys that are monotone and spread over a small
+// window: every key pushed must lie in [last popped key, last popped key + maxSpread],
+// unless the queue is empty, in which case the window moves to start at the new key.
+// Keys map onto a ring of maxSpread + 1 buckets, so push is O(1) and pop scans forward
+// over empty buckets, which is cheap while the window is small.
+template <typename Key, typename Value>
+class BucketQueue
+{
+  static_assert(std::is_unsigned_v<Key>, "BucketQueue keys must be unsigned integers.");
+
+private:
+  std::vector<std::vector<std::pair<Key, Value>>> buckets;
+  Key last;
+  size_t cursor;  // bucket of last
+  size_t size;
+
+public:
+  explicit BucketQueue(Key maxSpread)
+      : buckets(static_cast<size_t>(maxSpread) + 1), last(0), cursor(0), size(0)
+  {
+  }
+
+  size_t getSize() const { return size; }
+  bool empty() const { return !size; }
+  Key lastKey() const { return last; }
+
+  void push(Key key, const Value & value) { emplace(key, value); }
+  void push(Key key, Value && value) { emplace(key, std::move(value)); }
+
+  template <typename... Args>
+  void emplace(Key key, Args &&... args)
+  {
+    if (key < last || key - last >= buckets.size()) {
+      if (size) throw out_of_range("Key is outside the window of the bucket queue.");
+      last = key;  // an empty queue can move its window anywhere
+    }
+    size_t i = cursor + static_cast<size_t>(key - last);
+    if (i >= buckets.size()) i -= buckets.size();
+    buckets[i].emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    ++size;
+  }
+
+  void pop(Key & key, Value & value)
+  {
+    if (empty()) throw out_of_range("Cannot pop from empty queue");
+    while (buckets[cursor].empty()) {
+      if (++cursor == buckets.size()) cursor = 0;
+      ++last;
+    }
+    key = buckets[cursor].back().first;
+    value = std::move(buckets[cursor].back().second);
+    buckets[cursor].pop_back();
+    --size;
+  }
+
+  void clear() noexcept
+  {
+    for (auto & bucket : buckets) bucket.clear();
+    last = 0;
+    cursor = 0;
+    size = 0;
+  }
+};
+
+// Containers drawing their nodes from a std::pmr::memory_resource.
+template <typename T>
+using PmrLinkedList = LinkedList<T, std::pmr::polymorphic_allocator<T>>;
+template <typename T, typename Compare = std::less<T>>
+using PmrBST = BST<T, Compare, std::pmr::polymorphic_allocator<T>>;
+
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>,
+          typename Stats = NoStats>
+using RBTree = BST<T, Compare, Allocator, true, Stats>;
+
+#ifndef ALGOPACK_NO_MAIN
 int main()
 {
   // testing LinkedList
@@ -623,3 +6606,4 @@ int main()
 
   return 0;
 }
+#endif
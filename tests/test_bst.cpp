@@ -1,5 +1,18 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+
 #include "../main.cpp"
 
 TEST(BSTTest, EmptyTree)
@@ -229,3 +242,1176 @@ TEST(BSTTest, SequentialRotations)
     EXPECT_EQ(actual[i], expected[i]);
   }
 }
+
+TEST(BSTTest, PoolAllocator)
+{
+  BST<int, std::less<int>, PoolAllocator<int>> tree;
+  for (int i = 0; i < 200; ++i) tree.insert((i * 37) % 200);
+  EXPECT_EQ(tree.getSize(), 200);
+  for (int i = 0; i < 200; i += 2) tree.deleteNode(i);
+  for (int i = 0; i < 200; i += 2) tree.insert(i);
+  EXPECT_EQ(tree.getSize(), 200);
+
+  int expected = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) EXPECT_EQ(*it, expected++);
+}
+
+TEST(BSTTest, PmrAllocator)
+{
+  std::pmr::unsynchronized_pool_resource resource;
+  PmrBST<int> tree(&resource);
+  tree.insert(10);
+  tree.insert(5);
+  tree.insert(15);
+  EXPECT_TRUE(tree.search(5));
+  EXPECT_EQ(tree.getMinimum(), 5);
+  EXPECT_EQ(tree.get_allocator().resource(), &resource);
+}
+
+TEST(BSTTest, Emplace)
+{
+  BST<std::string> tree;
+  tree.emplace(3, 'c');
+  tree.emplace("a");
+  std::string b = "b";
+  tree.insert(std::move(b));
+
+  std::vector<std::string> actual;
+  for (auto it = tree.begin(); it != tree.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, (std::vector<std::string>{"a", "b", "ccc"}));
+}
+
+TEST(BSTTest, CopyPreservesShape)
+{
+  BST<int> tree;
+  for (int value : {10, 5, 15, 3, 7, 12, 20}) tree.insert(value);
+
+  BST<int> copy(tree);
+  tree.deleteNode(10);
+  EXPECT_EQ(copy.getSize(), 7);
+  EXPECT_TRUE(copy.search(10));
+
+  // Same shape: 10 is still the root, so rotating it left makes 15 the root
+  EXPECT_TRUE(copy.left_rotate(10));
+  EXPECT_TRUE(copy.right_rotate(15));
+
+  std::vector<int> expected = {3, 5, 7, 10, 12, 15, 20};
+  std::vector<int> actual;
+  for (auto it = copy.begin(); it != copy.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, expected);
+
+  BST<int> assigned;
+  assigned.insert(1);
+  assigned = copy;
+  actual.clear();
+  for (auto it = assigned.begin(); it != assigned.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, expected);
+}
+
+TEST(BSTTest, Move)
+{
+  BST<int> tree;
+  for (int value : {2, 1, 3}) tree.insert(value);
+  int * root = &*(++tree.begin());
+
+  BST<int> moved(std::move(tree));
+  EXPECT_TRUE(tree.empty());
+  EXPECT_EQ(moved.getSize(), 3);
+  EXPECT_EQ(&*(++moved.begin()), root);
+
+  BST<int> assigned;
+  assigned.insert(100);
+  assigned = std::move(moved);
+  EXPECT_TRUE(moved.empty());
+  EXPECT_EQ(assigned.getSize(), 3);
+  EXPECT_FALSE(assigned.search(100));
+  EXPECT_EQ(&*(++assigned.begin()), root);
+
+  moved.insert(5);
+  EXPECT_TRUE(moved.search(5));
+}
+
+TEST(BSTTest, UnbalancedHeight)
+{
+  BST<int> tree;
+  EXPECT_EQ(tree.getHeight(), 0);
+  for (int i = 0; i < 100; ++i) tree.insert(i);
+  EXPECT_EQ(tree.getHeight(), 100);
+}
+
+TEST(RBTreeTest, SortedInsertKeepsLogarithmicHeight)
+{
+  const int n = 1000000;
+  RBTree<int> tree;
+  for (int i = 0; i < n; ++i) tree.insert(i);
+
+  EXPECT_EQ(tree.getSize(), static_cast<size_t>(n));
+  EXPECT_LE(static_cast<double>(tree.getHeight()), 2 * std::log2(n + 1.0));
+  EXPECT_EQ(tree.getMinimum(), 0);
+  EXPECT_EQ(tree.getMaximum(), n - 1);
+  EXPECT_TRUE(tree.search(n / 2));
+  EXPECT_FALSE(tree.search(n));
+
+  int expected = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) ASSERT_EQ(*it, expected++);
+}
+
+TEST(RBTreeTest, DeletionKeepsLogarithmicHeight)
+{
+  const int n = 20000;
+  RBTree<int> tree;
+  for (int i = n; i > 0; --i) tree.insert(i);
+
+  // Remove every key not divisible by 3, in a scattered order
+  std::vector<int> order;
+  for (int i = 1; i <= n; ++i)
+    if (i % 3) order.push_back(i);
+  std::mt19937 rng(42);
+  std::shuffle(order.begin(), order.end(), rng);
+  for (size_t i = 0; i < order.size(); ++i) {
+    tree.deleteNode(order[i]);
+    if (i % 1000 == 0) {
+      ASSERT_LE(static_cast<double>(tree.getHeight()), 2 * std::log2(tree.getSize() + 1.0));
+    }
+  }
+
+  EXPECT_EQ(tree.getSize(), static_cast<size_t>(n / 3));
+  EXPECT_LE(static_cast<double>(tree.getHeight()), 2 * std::log2(n / 3 + 1.0));
+  int expected = 3;
+  for (auto it = tree.begin(); it != tree.end(); ++it, expected += 3) ASSERT_EQ(*it, expected);
+
+  while (!tree.empty()) tree.deleteNode(tree.getMinimum());
+  EXPECT_EQ(tree.getHeight(), 0);
+}
+
+TEST(RBTreeTest, DuplicatesAndCopies)
+{
+  RBTree<int> tree;
+  for (int round = 0; round < 3; ++round)
+    for (int i = 0; i < 100; ++i) tree.insert(i);
+  EXPECT_EQ(tree.getSize(), 300);
+
+  RBTree<int> copy(tree);
+  for (int i = 0; i < 100; ++i) copy.deleteNode(i);
+  EXPECT_EQ(copy.getSize(), 200);
+  EXPECT_LE(static_cast<double>(copy.getHeight()), 2 * std::log2(201.0));
+
+  // Manual rotations are refused because they would break the colouring
+  EXPECT_FALSE(tree.left_rotate(50));
+  EXPECT_FALSE(tree.right_rotate(50));
+}
+
+TEST(BSTTest, DegenerateTreeTeardown)
+{
+  // Teardown walks the tree without recursing once per level
+  BST<int> tree;
+  for (int i = 0; i < 20000; ++i) tree.insert(i);
+  EXPECT_EQ(tree.getHeight(), 20000);
+  tree.clear();
+  EXPECT_TRUE(tree.empty());
+  for (int i = 20000; i > 0; --i) tree.insert(i);
+}
+
+TEST(BSTTest, BulkBuildFromSortedRange)
+{
+  std::vector<int> keys(1000);
+  for (int i = 0; i < 1000; ++i) keys[i] = 2 * i;
+
+  BST<int> tree(keys.begin(), keys.end());
+  EXPECT_EQ(tree.getSize(), 1000);
+  EXPECT_EQ(tree.getHeight(), 10);  // ceil(log2(1001))
+  EXPECT_TRUE(tree.search(998));
+  EXPECT_FALSE(tree.search(999));
+
+  std::vector<int> actual;
+  for (auto it = tree.begin(); it != tree.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, keys);
+
+  tree.insert(1);
+  tree.deleteNode(0);
+  EXPECT_EQ(tree.getMinimum(), 1);
+}
+
+TEST(BSTTest, BulkBuildSortsUnsortedInput)
+{
+  std::vector<int> keys = {5, 3, 9, 1, 3, 7, 2};
+  BST<int> tree;
+  tree.insert(100);
+  tree.assign(keys.begin(), keys.end());
+
+  std::vector<int> actual;
+  for (auto it = tree.begin(); it != tree.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, (std::vector<int>{1, 2, 3, 3, 5, 7, 9}));
+  EXPECT_FALSE(tree.search(100));
+  EXPECT_EQ(tree.getHeight(), 3);
+
+  tree.assign(keys.end(), keys.end());
+  EXPECT_TRUE(tree.empty());
+}
+
+TEST(RBTreeTest, BulkBuildProducesValidColouring)
+{
+  for (int n : {1, 2, 3, 4, 7, 8, 100, 1023, 1024, 5000}) {
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i) keys[i] = i;
+    RBTree<int> tree(keys.begin(), keys.end());
+    ASSERT_EQ(tree.getSize(), static_cast<size_t>(n));
+
+    // Fixups rely on the colouring being valid, so churn the tree and re-check the bound
+    for (int i = 0; i < n; i += 2) tree.deleteNode(i);
+    for (int i = n; i < 2 * n; ++i) tree.insert(i);
+    EXPECT_LE(static_cast<double>(tree.getHeight()), 2 * std::log2(tree.getSize() + 1.0));
+    EXPECT_EQ(tree.getMaximum(), 2 * n - 1);
+  }
+}
+
+TEST(FrozenSetTest, MatchesTreeContents)
+{
+  for (int n : {0, 1, 2, 3, 7, 8, 15, 16, 100, 1000}) {
+    BST<int> tree;
+    std::vector<int> keys;
+    for (int i = 0; i < n; ++i) keys.push_back(3 * i);
+    std::mt19937 rng(n);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int key : keys) tree.insert(key);
+
+    FrozenSet<int> frozen = tree.freeze();
+    ASSERT_EQ(frozen.getSize(), static_cast<size_t>(n));
+    EXPECT_EQ(frozen.empty(), n == 0);
+
+    std::vector<int> iterated;
+    for (auto it = frozen.begin(); it != frozen.end(); ++it) iterated.push_back(*it);
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(iterated, keys);
+
+    for (int x = -1; x <= 3 * n; ++x) {
+      EXPECT_EQ(frozen.search(x), tree.search(x));
+      auto expected = std::lower_bound(keys.begin(), keys.end(), x);
+      auto actual = frozen.lower_bound(x);
+      if (expected == keys.end())
+        EXPECT_TRUE(actual == frozen.end());
+      else
+        EXPECT_EQ(*actual, *expected);
+    }
+  }
+}
+
+TEST(FrozenSetTest, BidirectionalIterationAndDuplicates)
+{
+  std::vector<int> values = {5, 1, 5, 3, 5, 9, 1};
+  FrozenSet<int> frozen(values.begin(), values.end());
+  EXPECT_EQ(frozen.getSize(), 7);
+  EXPECT_EQ(*frozen.lower_bound(5), 5);
+  EXPECT_EQ(*frozen.lower_bound(6), 9);
+  EXPECT_TRUE(frozen.lower_bound(10) == frozen.end());
+
+  // Walk back from the last element
+  auto it = frozen.lower_bound(9);
+  std::vector<int> backwards;
+  for (; it != frozen.end(); --it) backwards.push_back(*it);
+  EXPECT_EQ(backwards, (std::vector<int>{9, 5, 5, 5, 3, 1, 1}));
+
+  // The first 5 comes right after the 3
+  it = frozen.lower_bound(5);
+  --it;
+  EXPECT_EQ(*it, 3);
+}
+
+TEST(BSTTest, EmptyTreeIteration)
+{
+  BST<int> tree;
+  EXPECT_TRUE(tree.begin() == tree.end());
+  EXPECT_TRUE(tree.cbegin() == tree.cend());
+  EXPECT_TRUE(tree.freeze().empty());
+}
+
+template <typename Tree>
+static void checkOrderStatistics(Tree & tree, const std::vector<int> & sorted)
+{
+  ASSERT_EQ(tree.getSize(), sorted.size());
+  for (size_t k = 0; k < sorted.size(); ++k) ASSERT_EQ(tree.select(k), sorted[k]);
+  EXPECT_THROW(tree.select(sorted.size()), std::out_of_range);
+  for (int x = -2; x <= 102; ++x) {
+    size_t below = std::lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin();
+    ASSERT_EQ(tree.rank(x), below);
+    for (int y = x - 1; y <= x + 10; ++y) {
+      size_t expected = y < x ? 0
+                              : std::upper_bound(sorted.begin(), sorted.end(), y) -
+                                  std::lower_bound(sorted.begin(), sorted.end(), x);
+      ASSERT_EQ(tree.count_range(x, y), expected);
+    }
+  }
+}
+
+TEST(BSTTest, OrderStatistics)
+{
+  std::mt19937 rng(3);
+  BST<int> tree;
+  RBTree<int> balanced;
+  std::vector<int> sorted;
+  for (int step = 0; step < 400; ++step) {
+    int key = static_cast<int>(rng() % 100);
+    if (rng() % 4) {
+      tree.insert(key);
+      balanced.insert(key);
+      sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), key), key);
+    } else {
+      tree.deleteNode(key);
+      balanced.deleteNode(key);
+      auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+      if (it != sorted.end() && *it == key) sorted.erase(it);
+    }
+    if (step % 50 == 0) {
+      checkOrderStatistics(tree, sorted);
+      checkOrderStatistics(balanced, sorted);
+    }
+  }
+  checkOrderStatistics(tree, sorted);
+  checkOrderStatistics(balanced, sorted);
+}
+
+TEST(BSTTest, OrderStatisticsSurviveRotationsCopiesAndBulkBuild)
+{
+  BST<int> tree;
+  for (int value : {10, 5, 15, 3, 7, 12, 20}) tree.insert(value);
+  tree.left_rotate(10);
+  tree.right_rotate(15);
+  tree.left_rotate(5);
+  std::vector<int> sorted = {3, 5, 7, 10, 12, 15, 20};
+  checkOrderStatistics(tree, sorted);
+
+  BST<int> copy(tree);
+  checkOrderStatistics(copy, sorted);
+
+  BST<int> built(sorted.begin(), sorted.end());
+  checkOrderStatistics(built, sorted);
+  EXPECT_EQ(built.select(3), 10);
+  EXPECT_EQ(built.rank(11), 4);
+  EXPECT_EQ(built.count_range(4, 15), 5);
+}
+
+TEST(BSTTest, BatchedSearch)
+{
+  std::mt19937 rng(11);
+  BST<int> tree;
+  std::vector<int> present;
+  for (int i = 0; i < 5000; ++i) {
+    int key = static_cast<int>(rng() % 20000);
+    tree.insert(key);
+    present.push_back(key);
+  }
+
+  std::vector<int> keys;
+  for (int i = 0; i < 3000; ++i) keys.push_back(static_cast<int>(rng() % 20000));
+  keys.push_back(present.front());
+
+  std::vector<bool> found;
+  tree.contains_batch(keys, found);
+  std::vector<BST<int>::iterator> results;
+  tree.search_batch(keys, results);
+
+  ASSERT_EQ(found.size(), keys.size());
+  ASSERT_EQ(results.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(found[i], tree.search(keys[i]));
+    if (found[i])
+      EXPECT_EQ(*results[i], keys[i]);
+    else
+      EXPECT_TRUE(results[i] == tree.end());
+  }
+
+  std::vector<int> none;
+  tree.contains_batch(none, found);
+  EXPECT_TRUE(found.empty());
+
+  BST<int> empty;
+  empty.contains_batch(keys, found);
+  for (size_t i = 0; i < keys.size(); ++i) EXPECT_FALSE(found[i]);
+}
+
+// Strings and pairs take the other two descents of search_batch
+TEST(BSTTest, BatchedSearchOfCompositeKeys)
+{
+  std::mt19937 rng(12);
+  RBTree<std::string> words;
+  RBTree<std::pair<int, int>> pairs;
+  for (int i = 0; i < 2000; ++i) {
+    int key = static_cast<int>(rng() % 4000);
+    words.insert(std::to_string(key));
+    pairs.insert({key / 10, key % 10});
+  }
+
+  std::vector<std::string> wordKeys;
+  std::vector<std::pair<int, int>> pairKeys;
+  for (int i = 0; i < 1000; ++i) {
+    int key = static_cast<int>(rng() % 4000);
+    wordKeys.push_back(std::to_string(key));
+    pairKeys.push_back({key / 10, key % 10});
+  }
+  std::vector<bool> found;
+  words.contains_batch(wordKeys, found);
+  for (size_t i = 0; i < wordKeys.size(); ++i) EXPECT_EQ(found[i], words.search(wordKeys[i]));
+  std::vector<RBTree<std::pair<int, int>>::iterator> results;
+  pairs.search_batch(pairKeys, results);
+  for (size_t i = 0; i < pairKeys.size(); ++i) {
+    if (pairs.search(pairKeys[i])) {
+      EXPECT_TRUE(*results[i] == pairKeys[i]);
+    } else {
+      EXPECT_TRUE(results[i] == pairs.end());
+    }
+  }
+}
+
+TEST(BSTTest, BoundsAndRangeView)
+{
+  BST<int> tree;
+  for (int key : {20, 10, 30, 10, 25, 40, 5}) tree.insert(key);
+
+  EXPECT_EQ(*tree.lower_bound(10), 10);
+  EXPECT_EQ(*tree.upper_bound(10), 20);
+  EXPECT_EQ(*tree.lower_bound(11), 20);
+  EXPECT_EQ(*tree.lower_bound(1), 5);
+  EXPECT_TRUE(tree.lower_bound(41) == tree.end());
+  EXPECT_TRUE(tree.upper_bound(40) == tree.end());
+
+  auto tens = tree.equal_range(10);
+  int copies = 0;
+  for (auto it = tens.first; it != tens.second; ++it, ++copies) EXPECT_EQ(*it, 10);
+  EXPECT_EQ(copies, 2);
+  auto missing = tree.equal_range(15);
+  EXPECT_TRUE(missing.first == missing.second);
+
+  std::vector<int> window;
+  for (int v : tree.range(10, 30)) window.push_back(v);
+  EXPECT_EQ(window, (std::vector<int>{10, 10, 20, 25, 30}));
+  EXPECT_TRUE(tree.range(26, 29).empty());
+  EXPECT_TRUE(tree.range(30, 10).empty());
+
+  const BST<int> & constTree = tree;
+  window.clear();
+  for (int v : constTree.range(21, 100)) window.push_back(v);
+  EXPECT_EQ(window, (std::vector<int>{25, 30, 40}));
+  EXPECT_EQ(*constTree.lower_bound(26), 30);
+}
+
+TEST(BSTTest, EraseRange)
+{
+  for (bool wide : {false, true}) {
+    std::mt19937 rng(wide ? 5 : 6);
+    RBTree<int> tree;
+    std::multiset<int> reference;
+    for (int i = 0; i < 4000; ++i) {
+      int key = static_cast<int>(rng() % 3000);
+      tree.insert(key);
+      reference.insert(key);
+    }
+
+    int lo = wide ? 100 : 1400;
+    int hi = wide ? 2900 : 1600;
+    size_t expected = std::distance(reference.lower_bound(lo), reference.upper_bound(hi));
+    reference.erase(reference.lower_bound(lo), reference.upper_bound(hi));
+    EXPECT_EQ(tree.erase_range(lo, hi), expected);
+    EXPECT_EQ(tree.erase_range(lo, hi), 0u);
+    EXPECT_EQ(tree.erase_range(hi, lo), 0u);
+
+    std::vector<int> contents;
+    for (int v : tree) contents.push_back(v);
+    EXPECT_EQ(contents, std::vector<int>(reference.begin(), reference.end()));
+    EXPECT_EQ(tree.getSize(), reference.size());
+    EXPECT_LE(tree.getHeight(), 2 * std::log2(tree.getSize() + 1));
+    checkOrderStatistics(tree, contents);
+  }
+
+  BST<int> tree;
+  for (int key : {3, 1, 2}) tree.insert(key);
+  EXPECT_EQ(tree.erase_range(0, 10), 3u);
+  EXPECT_TRUE(tree.empty());
+  EXPECT_TRUE(tree.begin() == tree.end());
+}
+
+TEST(PersistentBSTTest, SnapshotsAreIsolatedFromLaterWrites)
+{
+  PersistentBST<int> tree;
+  for (int key : {50, 30, 70, 20, 40, 60, 80}) tree.insert(key);
+  auto before = tree.snapshot();
+
+  tree.insert(35);
+  tree.deleteNode(70);
+  tree.deleteNode(99);
+  auto after = tree.snapshot();
+
+  std::vector<int> oldContents;
+  for (int v : before) oldContents.push_back(v);
+  std::vector<int> newContents;
+  for (int v : after) newContents.push_back(v);
+  EXPECT_EQ(oldContents, (std::vector<int>{20, 30, 40, 50, 60, 70, 80}));
+  EXPECT_EQ(newContents, (std::vector<int>{20, 30, 35, 40, 50, 60, 80}));
+  EXPECT_TRUE(before.search(70));
+  EXPECT_FALSE(after.search(70));
+  EXPECT_FALSE(tree.search(70));
+  EXPECT_TRUE(tree.search(35));
+  EXPECT_EQ(before.getSize(), 7u);
+  EXPECT_EQ(tree.getSize(), 7u);
+
+  tree.clear();
+  EXPECT_TRUE(tree.empty());
+  EXPECT_TRUE(tree.snapshot().begin() == tree.snapshot().end());
+  EXPECT_THROW(tree.snapshot().getMinimum(), std::out_of_range);
+  EXPECT_EQ(after.getMinimum(), 20);
+  EXPECT_EQ(after.getMaximum(), 80);
+}
+
+TEST(PersistentBSTTest, RandomOperationsMatchMultisetAndStayBalanced)
+{
+  std::mt19937 rng(3);
+  PersistentBST<int> tree;
+  std::multiset<int> reference;
+  for (int i = 0; i < 20000; ++i) {
+    int key = static_cast<int>(rng() % 1000);
+    if (rng() % 3) {
+      tree.insert(key);
+      reference.insert(key);
+    } else {
+      tree.deleteNode(key);
+      auto it = reference.find(key);
+      if (it != reference.end()) reference.erase(it);
+    }
+  }
+  for (int i = 0; i < 100000; ++i) tree.insert(i + 1000);
+  for (int i = 0; i < 100000; ++i) reference.insert(i + 1000);
+
+  auto snapshot = tree.snapshot();
+  std::vector<int> contents;
+  for (int v : snapshot) contents.push_back(v);
+  EXPECT_EQ(contents, std::vector<int>(reference.begin(), reference.end()));
+  EXPECT_EQ(snapshot.getSize(), reference.size());
+  EXPECT_LE(snapshot.getHeight(), 1.45 * std::log2(reference.size() + 2));
+}
+
+TEST(PersistentBSTTest, ReadersSeeConsistentVersionsWhileWriterRuns)
+{
+  // The writer slides a window of consecutive keys forward by inserting one past the end
+  // and then deleting the first, so any snapshot must be a run of consecutive keys whose
+  // length is window or, between the two writes, window + 1.
+  PersistentBST<int> tree;
+  const int window = 256;
+  for (int i = 0; i < window; ++i) tree.insert(i);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        auto snapshot = tree.snapshot();
+        size_t size = snapshot.getSize();
+        if (size != window && size != window + 1) ++failures;
+        int expected = snapshot.getMinimum();
+        size_t seen = 0;
+        for (int v : snapshot) {
+          if (v != expected++) ++failures;
+          ++seen;
+        }
+        if (seen != size) ++failures;
+        if (!snapshot.search(snapshot.getMaximum())) ++failures;
+      }
+    });
+  }
+  for (int lo = 0; lo < 20000; ++lo) {
+    tree.insert(lo + window);
+    tree.deleteNode(lo);
+  }
+  done.store(true);
+  for (std::thread & t : readers) t.join();
+  EXPECT_EQ(failures.load(), 0);
+}
+
+template <typename Tree>
+static auto contentsOf(Tree & tree)
+{
+  std::vector<std::decay_t<decltype(*tree.begin())>> values;
+  for (const auto & v : tree) values.push_back(v);
+  return values;
+}
+
+template <typename Tree>
+static void checkSplitAndJoin()
+{
+  std::mt19937 rng(9);
+  std::vector<int> keys;
+  for (int i = 0; i < 5000; ++i) keys.push_back(static_cast<int>(rng() % 2000));
+  Tree original;
+  for (int key : keys) original.insert(key);
+  std::vector<int> sorted = contentsOf(original);
+
+  for (int key : {-1, 0, 1, 777, 1000, 1999, 2000, 5000}) {
+    Tree lower = original;
+    Tree upper = lower.split(key);
+    size_t cut = std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin();
+    EXPECT_EQ(contentsOf(lower), std::vector<int>(sorted.begin(), sorted.begin() + cut));
+    EXPECT_EQ(contentsOf(upper), std::vector<int>(sorted.begin() + cut, sorted.end()));
+    checkOrderStatistics(lower, contentsOf(lower));
+    checkOrderStatistics(upper, contentsOf(upper));
+
+    Tree joined = Tree::join(std::move(lower), std::move(upper));
+    EXPECT_EQ(contentsOf(joined), sorted);
+    EXPECT_EQ(joined.getSize(), sorted.size());
+    checkOrderStatistics(joined, sorted);
+  }
+}
+
+TEST(BSTTest, SplitAndJoin)
+{
+  checkSplitAndJoin<BST<int>>();
+  checkSplitAndJoin<RBTree<int>>();
+}
+
+TEST(BSTTest, JoinOntoLongRightSpine)
+{
+  // Joining single nodes on the left builds a right spine as long as the tree; joining
+  // after it has to take the last node off that spine without recursing down it
+  const int n = 1000000;
+  BST<int> spine;
+  for (int i = n - 1; i >= 0; --i) {
+    BST<int> single;
+    single.insert(i);
+    spine = BST<int>::join(std::move(single), std::move(spine));
+  }
+  BST<int> last;
+  last.insert(n);
+  BST<int> joined = BST<int>::join(std::move(spine), std::move(last));
+  EXPECT_EQ(joined.getSize(), static_cast<size_t>(n) + 1);
+  EXPECT_EQ(joined.getMinimum(), 0);
+  EXPECT_EQ(joined.getMaximum(), n);
+  EXPECT_EQ(joined.select(n / 2), n / 2);
+  EXPECT_EQ(joined.rank(n - 1), static_cast<size_t>(n) - 1);
+  int expected = 0;
+  for (int v : joined) ASSERT_EQ(v, expected++);
+  EXPECT_EQ(expected, n + 1);
+}
+
+TEST(RBTreeTest, SplitAndJoinKeepLogarithmicHeight)
+{
+  RBTree<int> tree;
+  for (int i = 0; i < 100000; ++i) tree.insert(i);
+  RBTree<int> upper = tree.split(12345);
+  EXPECT_LE(tree.getHeight(), 2 * std::log2(tree.getSize() + 1));
+  EXPECT_LE(upper.getHeight(), 2 * std::log2(upper.getSize() + 1));
+
+  RBTree<int> small;
+  small.insert(-1);
+  RBTree<int> joined = RBTree<int>::join(std::move(small), std::move(upper));
+  EXPECT_EQ(joined.getMinimum(), -1);
+  EXPECT_EQ(joined.getSize(), 100000u - 12345u + 1u);
+  EXPECT_LE(joined.getHeight(), 2 * std::log2(joined.getSize() + 1));
+}
+
+template <typename Tree>
+static void checkSetOperations(size_t sizeA, size_t sizeB, int range)
+{
+  std::mt19937 rng(static_cast<unsigned>(sizeA + sizeB));
+  std::vector<int> a, b;
+  for (size_t i = 0; i < sizeA; ++i) a.push_back(static_cast<int>(rng() % range));
+  for (size_t i = 0; i < sizeB; ++i) b.push_back(static_cast<int>(rng() % range));
+  Tree treeA(a.begin(), a.end());
+  Tree treeB;
+  for (int key : b) treeB.insert(key);
+  std::sort(a.begin(), a.end());
+  std::sort(b.begin(), b.end());
+
+  std::vector<int> expected;
+  Tree result = treeA;
+  result.union_with(treeB);
+  std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+  EXPECT_EQ(contentsOf(result), expected);
+  checkOrderStatistics(result, expected);
+
+  expected.clear();
+  result = treeA;
+  result.intersect_with(treeB);
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+  EXPECT_EQ(contentsOf(result), expected);
+  checkOrderStatistics(result, expected);
+
+  expected.clear();
+  result = treeA;
+  result.difference(std::move(treeB));
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+  EXPECT_EQ(contentsOf(result), expected);
+  checkOrderStatistics(result, expected);
+  EXPECT_LE(result.getHeight(), 2 * std::log2(result.getSize() + 1) + 2);
+  EXPECT_EQ(contentsOf(treeA), a);
+}
+
+TEST(BSTTest, SetOperationsMatchStdAlgorithms)
+{
+  checkSetOperations<RBTree<int>>(40000, 30000, 100000);
+  checkSetOperations<RBTree<int>>(50000, 200, 1000000);
+  checkSetOperations<RBTree<int>>(300, 3000, 100);
+  checkSetOperations<RBTree<int>>(0, 100, 50);
+  checkSetOperations<RBTree<int>>(100, 0, 50);
+  checkSetOperations<BST<int>>(20000, 20000, 30000);
+  checkSetOperations<BST<int>>(500, 5000, 200);
+}
+
+TEST(BSTTest, SetOperationsWithUnequalAllocators)
+{
+  PoolAllocator<int> poolA, poolB;
+  BST<int, std::less<int>, PoolAllocator<int>> a(poolA), b(poolB);
+  for (int i = 0; i < 100; i += 2) a.insert(i);
+  for (int i = 0; i < 100; i += 3) b.insert(i);
+  a.union_with(b);
+  EXPECT_EQ(a.getSize(), 67u);
+  a.intersect_with(std::move(b));
+  EXPECT_EQ(a.getSize(), 34u);
+  EXPECT_EQ(a.rank(50), 17u);
+}
+
+// Counts allocations made through any copy in allocationTally. As with PoolAllocator, a
+// copied container gets an allocator of its own that compares unequal to the source's.
+static size_t allocationTally = 0;
+
+template <typename T>
+struct TallyAllocator
+{
+  using value_type = T;
+
+  int id;
+
+  TallyAllocator() : id(nextId()) {}
+  template <typename U>
+  TallyAllocator(const TallyAllocator<U> & other) : id(other.id)
+  {
+  }
+
+  static int nextId()
+  {
+    static int ids = 0;
+    return ++ids;
+  }
+
+  T * allocate(size_t n)
+  {
+    allocationTally += n;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T * p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+  TallyAllocator select_on_container_copy_construction() const { return TallyAllocator(); }
+
+  template <typename U>
+  bool operator==(const TallyAllocator<U> & other) const
+  {
+    return id == other.id;
+  }
+  template <typename U>
+  bool operator!=(const TallyAllocator<U> & other) const
+  {
+    return id != other.id;
+  }
+};
+
+TEST(BSTTest, ConstSetOperandIsCopiedOnce)
+{
+  TallyAllocator<int> shared;
+  RBTree<int, std::less<int>, TallyAllocator<int>> a(shared), b(shared);
+  for (int i = 0; i < 100; i += 2) a.insert(i);
+  for (int i = 0; i < 100; i += 3) b.insert(i);
+
+  allocationTally = 0;
+  a.union_with(b);
+  EXPECT_EQ(allocationTally, b.getSize());
+  EXPECT_EQ(a.getSize(), 67u);
+  EXPECT_EQ(b.getSize(), 34u);
+
+  allocationTally = 0;
+  const auto & constB = b;
+  a.difference(constB);
+  EXPECT_EQ(allocationTally, b.getSize());
+  EXPECT_EQ(a.getSize(), 33u);
+}
+
+TEST(BSTTest, CountingStatsTrackHotPaths)
+{
+  static_assert(
+    sizeof(BST<int>) == sizeof(BST<int, std::less<int>, std::allocator<int>, false, NoStats>));
+
+  BST<int, std::less<int>, std::allocator<int>, false, CountingStats> tree;
+  for (int v : {4, 2, 6, 1, 3, 5, 7}) tree.insert(v);
+  CountingStats stats = tree.stats();
+  EXPECT_EQ(stats.allocations, 7);
+  EXPECT_EQ(stats.frees, 0);
+  EXPECT_EQ(stats.max_height, 3);
+  EXPECT_EQ(stats.height, 3);
+
+  tree.reset_stats();
+  EXPECT_TRUE(tree.search(4));
+  EXPECT_TRUE(tree.search(7));
+  EXPECT_FALSE(tree.search(8));
+  stats = tree.stats();
+  EXPECT_EQ(stats.searches, 3);
+  // Ints are ordered three ways, one comparison per node, and a lookup stops at a match
+  EXPECT_EQ(stats.nodes_visited, 1 + 3 + 3);
+  EXPECT_EQ(stats.comparisons, 1 + 3 + 3);
+
+  tree.clear();
+  EXPECT_EQ(tree.stats().frees, 7);
+  EXPECT_EQ(tree.stats().height, 0);
+}
+
+TEST(RBTreeTest, CountingStatsSeeRotations)
+{
+  RBTree<int, std::less<int>, std::allocator<int>, CountingStats> tree;
+  const int n = 1024;
+  for (int i = 0; i < n; ++i) tree.insert(i);
+  CountingStats stats = tree.stats();
+  EXPECT_GT(stats.rotations, 0);
+  EXPECT_LE(stats.max_height, 2 * std::log2(n + 1));
+  EXPECT_EQ(stats.height, tree.getHeight());
+
+  for (int i = 0; i < n; ++i) tree.deleteNode(i);
+  EXPECT_EQ(tree.stats().allocations, tree.stats().frees);
+}
+
+TEST(BSTTest, SnapshotRoundTrip)
+{
+  const std::string path = ::testing::TempDir() + "algopack_bst.snapshot";
+  std::mt19937 rng(20);
+  for (size_t n : {0, 1, 1000, 50000}) {
+    RBTree<int> tree;
+    for (size_t i = 0; i < n; ++i) tree.insert(static_cast<int>(rng() % (n + 1)));
+    tree.save(path);
+
+    RBTree<int> loaded = RBTree<int>::load(path);
+    EXPECT_EQ(contentsOf(loaded), contentsOf(tree));
+    EXPECT_LE(loaded.getHeight(), std::log2(n + 1) + 1);
+
+    BST<int> unbalanced = BST<int>::load(path);
+    EXPECT_EQ(contentsOf(unbalanced), contentsOf(tree));
+    EXPECT_LE(unbalanced.getHeight(), std::log2(n + 1) + 1);
+
+    SnapshotView<int> view(path);
+    EXPECT_TRUE(view.sorted());
+    EXPECT_EQ(view.getSize(), n);
+    EXPECT_EQ(std::vector<int>(view.begin(), view.end()), contentsOf(tree));
+    for (int v = -1; v <= static_cast<int>(n) + 1; v += 7)
+      EXPECT_EQ(view.search(v), tree.search(v));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(BSTTest, SnapshotRejectsDamagedFiles)
+{
+  const std::string path = ::testing::TempDir() + "algopack_damaged.snapshot";
+  RBTree<int> tree;
+  for (int i = 0; i < 1000; ++i) tree.insert(i);
+  tree.save(path);
+  EXPECT_THROW(SnapshotView<double> wrongType(path), std::runtime_error);
+
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(sizeof(SnapshotHeader) + 2000);
+  file.put('\x7f');
+  file.close();
+  EXPECT_THROW(RBTree<int>::load(path), std::runtime_error);
+
+  std::ofstream(path, std::ios::binary) << "not a snapshot";
+  EXPECT_THROW(SnapshotView<int> garbage(path), std::runtime_error);
+  std::remove(path.c_str());
+  EXPECT_THROW(SnapshotView<int> missing(path), std::runtime_error);
+
+  tree.save(path);
+  std::ofstream(path, std::ios::binary | std::ios::app) << 'x';
+  EXPECT_THROW(SnapshotView<int> padded(path), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(BSTTest, CustomComparatorOrdersTree)
+{
+  RBTree<int, std::greater<int>> tree;
+  for (int i = 0; i < 100; ++i) tree.insert(i % 50);
+  std::vector<int> expected;
+  for (int i = 49; i >= 0; --i) expected.insert(expected.end(), 2, i);
+  EXPECT_EQ(contentsOf(tree), expected);
+  EXPECT_TRUE(tree.search(7));
+  EXPECT_FALSE(tree.search(50));
+  EXPECT_EQ(*tree.lower_bound(10), 10);
+  EXPECT_EQ(*tree.upper_bound(10), 9);
+  EXPECT_EQ(tree.rank(10), 78u);
+  EXPECT_EQ(tree.count_range(20, 10), 22u);
+  EXPECT_EQ(tree.count_range(10, 20), 0u);
+  EXPECT_EQ(tree.getMinimum(), 49);
+
+  RBTree<int, std::greater<int>> lower = tree.split(25);
+  EXPECT_EQ(tree.getMaximum(), 26);
+  EXPECT_EQ(lower.getMinimum(), 25);
+  tree.union_with(std::move(lower));
+  EXPECT_EQ(contentsOf(tree), expected);
+
+  FrozenSet<int, std::greater<int>> frozen = tree.freeze();
+  EXPECT_EQ(*frozen.begin(), 49);
+  EXPECT_TRUE(frozen.search(3));
+  EXPECT_EQ(*frozen.lower_bound(60), 49);
+
+  tree.erase_range(40, 10);
+  EXPECT_EQ(tree.getSize(), 38u);
+  for (int i = 0; i < 50; ++i) tree.deleteNode(i);
+  EXPECT_EQ(tree.getSize(), 19u);
+}
+
+TEST(BSTTest, TransparentLookupTakesStringViews)
+{
+  BST<std::string, std::less<>> tree;
+  for (const char * word : {"pear", "apple", "fig", "plum", "fig", "cherry"}) tree.insert(word);
+  std::string_view fig = "fig";
+  EXPECT_TRUE(tree.search(fig));
+  EXPECT_FALSE(tree.search(std::string_view("grape")));
+  EXPECT_EQ(*tree.find(fig), "fig");
+  EXPECT_TRUE(tree.find(std::string_view("kiwi")) == tree.end());
+  EXPECT_EQ(*tree.lower_bound(std::string_view("d")), "fig");
+  EXPECT_EQ(*tree.upper_bound(fig), "pear");
+  auto [first, last] = tree.equal_range(fig);
+  EXPECT_EQ(*first, "fig");
+  EXPECT_EQ(*++first, "fig");
+  EXPECT_TRUE(++first == last);
+
+  const auto & constTree = tree;
+  EXPECT_EQ(*constTree.find(std::string_view("plum")), "plum");
+  EXPECT_TRUE(constTree.find(std::string("kiwi")) == constTree.cend());
+}
+
+TEST(BSTMapTest, MatchesStdMap)
+{
+  std::mt19937 rng(24);
+  BSTMap<int, int> map;
+  std::map<int, int> reference;
+  for (int i = 0; i < 20000; ++i) {
+    int key = static_cast<int>(rng() % 1000);
+    switch (rng() % 4) {
+      case 0:
+        map[key] += i;
+        reference[key] += i;
+        break;
+      case 1:
+        EXPECT_EQ(map.try_emplace(key, i).second, reference.try_emplace(key, i).second);
+        break;
+      case 2:
+        EXPECT_EQ(map.erase(key), reference.erase(key) > 0);
+        break;
+      default:
+        auto it = map.find(key);
+        auto expected = reference.find(key);
+        ASSERT_EQ(it == map.end(), expected == reference.end());
+        if (expected != reference.end()) {
+          EXPECT_EQ((*it).second, expected->second);
+        }
+    }
+  }
+  EXPECT_EQ(map.getSize(), reference.size());
+  using Pairs = std::vector<std::pair<int, int>>;
+  Pairs contents;
+  for (auto it = map.begin(); it != map.end(); ++it)
+    contents.emplace_back((*it).first, (*it).second);
+  EXPECT_EQ(contents, Pairs(reference.begin(), reference.end()));
+}
+
+TEST(BSTMapTest, StringKeysAndTryEmplace)
+{
+  BSTMap<std::string, std::unique_ptr<int>, std::less<>> map;
+  auto value = std::make_unique<int>(1);
+  EXPECT_TRUE(map.try_emplace("one", std::move(value)).second);
+  EXPECT_FALSE(value);
+
+  // A present key leaves the arguments untouched
+  value = std::make_unique<int>(2);
+  auto [it, inserted] = map.try_emplace("one", std::move(value));
+  EXPECT_FALSE(inserted);
+  EXPECT_TRUE(value);
+  EXPECT_EQ(*(*it).second, 1);
+
+  map["two"] = std::move(value);
+  EXPECT_EQ(*map.at("two"), 2);
+  EXPECT_EQ(*(*map.find(std::string_view("two"))).second, 2);
+  EXPECT_TRUE(map.search("one"));
+  EXPECT_FALSE(map["three"]);
+  EXPECT_EQ(map.getSize(), 3u);
+  EXPECT_THROW(map.at("four"), std::out_of_range);
+
+  const auto & constMap = map;
+  EXPECT_EQ((*constMap.lower_bound("p")).first, "three");
+  EXPECT_TRUE(constMap.find(std::string_view("zero")) == constMap.cend());
+}
+
+// Counts its calls, to check how many comparisons lookups make
+struct CountingLess
+{
+  size_t * calls;
+
+  bool operator()(const std::string & a, const std::string & b) const
+  {
+    ++*calls;
+    return a < b;
+  }
+};
+
+TEST(BSTMapTest, LookupsCompareKeysOncePerLevel)
+{
+  size_t calls = 0;
+  BSTMap<std::string, int, CountingLess> map(CountingLess{&calls});
+  const int n = 1023;
+  std::vector<std::string> keys;
+  for (int i = 0; i < n; ++i) keys.push_back("key" + std::to_string(i * 7919 % n));
+  for (const std::string & key : keys) map[key] = 0;
+
+  // A red-black tree of n keys is at most 2 * log2(n + 1) = 20 levels deep, so asking the
+  // comparator both ways at each node would cost up to 40 calls
+  for (const std::string & key : keys) {
+    calls = 0;
+    ASSERT_TRUE(map.find(key) != map.end());
+    EXPECT_LE(calls, 21u);
+    calls = 0;
+    EXPECT_FALSE(map.try_emplace(key, 1).second);
+    EXPECT_LE(calls, 21u);
+  }
+
+  // Near-balanced, the tree is about log2(n) levels deep on average; two calls per level
+  // would come to about twice that
+  calls = 0;
+  for (const std::string & key : keys) EXPECT_FALSE(map.search(key + "!"));
+  EXPECT_LT(calls, (std::log2(n + 1) + 3) * n);
+}
+
+template <typename Tree>
+void checkCompactAgainstMultiset(unsigned seed)
+{
+  std::mt19937 rng(seed);
+  Tree tree;
+  std::multiset<int> reference;
+  for (int i = 0; i < 20000; ++i) {
+    int key = static_cast<int>(rng() % 2000);
+    if (rng() % 3) {
+      tree.insert(key);
+      reference.insert(key);
+    } else {
+      tree.deleteNode(key);
+      auto it = reference.find(key);
+      if (it != reference.end()) reference.erase(it);
+    }
+    if (i % 5000 == 0) {
+      EXPECT_EQ(tree.search(key), reference.count(key) > 0);
+    }
+  }
+  EXPECT_EQ(tree.getSize(), reference.size());
+  EXPECT_EQ(contentsOf(tree), std::vector<int>(reference.begin(), reference.end()));
+  EXPECT_EQ(tree.getMinimum(), *reference.begin());
+  EXPECT_EQ(tree.getMaximum(), *reference.rbegin());
+
+  size_t height = tree.getHeight();
+  for (CompactOrder order : {CompactOrder::VanEmdeBoas, CompactOrder::InOrder}) {
+    tree.compact(order);
+    EXPECT_EQ(tree.capacity(), reference.size());
+    EXPECT_EQ(tree.getHeight(), height);
+    EXPECT_EQ(contentsOf(tree), std::vector<int>(reference.begin(), reference.end()));
+    for (int key = 0; key < 2000; key += 13) EXPECT_EQ(tree.search(key), reference.count(key) > 0);
+  }
+
+  // Keeps working after compaction, growing from the exact-fit array
+  for (int key = 0; key < 100; ++key) tree.insert(key);
+  for (int key = 0; key < 100; ++key) reference.insert(key);
+  EXPECT_EQ(contentsOf(tree), std::vector<int>(reference.begin(), reference.end()));
+}
+
+TEST(CompactBSTTest, MatchesMultiset)
+{
+  checkCompactAgainstMultiset<CompactBST<int>>(22);
+  checkCompactAgainstMultiset<CompactBST<int, std::less<int>, std::allocator<int>, true>>(23);
+}
+
+TEST(CompactBSTTest, BalancedStaysLogarithmicAndReusesSlots)
+{
+  CompactBST<int, std::less<int>, std::allocator<int>, true> tree;
+  EXPECT_TRUE(tree.empty());
+  EXPECT_THROW(tree.getMinimum(), std::out_of_range);
+  const int n = 1 << 14;
+  for (int i = 0; i < n; ++i) tree.insert(i);
+  EXPECT_LE(tree.getHeight(), 2 * std::log2(n + 1));
+
+  size_t capacity = tree.capacity();
+  for (int i = 0; i < n; i += 2) tree.deleteNode(i);
+  for (int i = 0; i < n; i += 2) tree.insert(-i);
+  EXPECT_EQ(tree.capacity(), capacity);
+  EXPECT_EQ(tree.getSize(), n);
+  EXPECT_LE(tree.getHeight(), 2 * std::log2(n + 1));
+
+  tree.clear();
+  EXPECT_EQ(tree.capacity(), 0);
+  tree.compact(CompactOrder::VanEmdeBoas);
+  EXPECT_TRUE(tree.empty());
+}
+
+TEST(CompactBSTTest, NonTrivialValuesCopyAndMove)
+{
+  CompactBST<std::string> tree;
+  for (int i = 0; i < 200; ++i) tree.emplace(std::to_string(i * 37 % 200));
+  for (int i = 0; i < 200; i += 3) tree.deleteNode(std::to_string(i));
+
+  CompactBST<std::string> copy(tree);
+  tree.compact(CompactOrder::VanEmdeBoas);
+  EXPECT_EQ(contentsOf(copy), contentsOf(tree));
+
+  CompactBST<std::string> moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_TRUE(moved.search("100"));
+  EXPECT_FALSE(moved.search("99"));
+
+  copy = moved;
+  moved = std::move(tree);
+  EXPECT_EQ(contentsOf(copy), contentsOf(moved));
+
+  std::pmr::unsynchronized_pool_resource a;
+  std::pmr::unsynchronized_pool_resource b;
+  using PmrCompactBST =
+    CompactBST<std::string, std::less<std::string>, std::pmr::polymorphic_allocator<std::string>>;
+  PmrCompactBST source(&a);
+  PmrCompactBST target(&b);
+  for (const char * s : {"m", "c", "x"}) source.insert(s);
+  target = std::move(source);
+  EXPECT_EQ(target.get_allocator().resource(), &b);
+  EXPECT_EQ(contentsOf(target), (std::vector<std::string>{"c", "m", "x"}));
+  EXPECT_TRUE(source.empty());
+}
+
+TEST(CompactBSTTest, CustomComparatorAndTransparentLookup)
+{
+  CompactBST<int, std::greater<int>, std::allocator<int>, true> descending;
+  for (int i = 0; i < 100; ++i) descending.insert(i * 37 % 100);
+  std::vector<int> expected(100);
+  for (int i = 0; i < 100; ++i) expected[i] = 99 - i;
+  EXPECT_EQ(contentsOf(descending), expected);
+  EXPECT_EQ(descending.getMinimum(), 99);
+  EXPECT_TRUE(descending.search(42));
+  descending.deleteNode(42);
+  EXPECT_FALSE(descending.search(42));
+
+  CompactBST<std::string, std::less<>> words;
+  for (const char * word : {"pear", "apple", "fig"}) words.insert(word);
+  EXPECT_TRUE(words.search(std::string_view("fig")));
+  EXPECT_FALSE(words.search(std::string_view("kiwi")));
+  EXPECT_EQ(*words.find(std::string_view("pear")), "pear");
+  EXPECT_TRUE(words.find(std::string_view("plum")) == words.end());
+}
+
+TEST(CompactBSTTest, InsertingOwnElementIntoFullArray)
+{
+  // The argument lives in the array that insert has to replace
+  CompactBST<std::string> tree;
+  for (int i = 0; i < 16; ++i) tree.insert(std::string(20, static_cast<char>('a' + i)));
+  ASSERT_EQ(tree.capacity(), tree.getSize());
+  tree.insert(*tree.begin());
+  for (int i = 0; i < 15; ++i) tree.insert(std::string(20, 'z'));
+  ASSERT_EQ(tree.capacity(), tree.getSize());
+  tree.emplace(*++tree.begin());
+  std::vector<std::string> values = contentsOf(tree);
+  ASSERT_EQ(values.size(), 33u);
+  for (int i = 0; i < 3; ++i) EXPECT_EQ(values[i], std::string(20, 'a'));
+  EXPECT_EQ(values[3], std::string(20, 'b'));
+}
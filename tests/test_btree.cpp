@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <set>
+
+#include "../main.cpp"
+
+TEST(BTreeTest, EmptyTree)
+{
+  BTree<int> tree;
+  EXPECT_EQ(tree.getSize(), 0);
+  EXPECT_TRUE(tree.empty());
+  EXPECT_FALSE(tree.search(10));
+  EXPECT_TRUE(tree.begin() == tree.end());
+  EXPECT_THROW(tree.getMinimum(), std::out_of_range);
+  EXPECT_THROW(tree.getMaximum(), std::out_of_range);
+  tree.deleteNode(10);  // Should not throw, just do nothing
+  EXPECT_EQ(tree.getHeight(), 0);
+}
+
+TEST(BTreeTest, InsertionAndSearch)
+{
+  BTree<int, 4> tree;
+  for (int i = 0; i < 1000; ++i) tree.insert((i * 7919) % 1000);
+
+  EXPECT_EQ(tree.getSize(), 1000);
+  for (int i = 0; i < 1000; ++i) EXPECT_TRUE(tree.search(i));
+  EXPECT_FALSE(tree.search(-1));
+  EXPECT_FALSE(tree.search(1000));
+  EXPECT_EQ(tree.getMinimum(), 0);
+  EXPECT_EQ(tree.getMaximum(), 999);
+
+  int expected = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) EXPECT_EQ(*it, expected++);
+  EXPECT_EQ(expected, 1000);
+}
+
+TEST(BTreeTest, SortedInsertStaysShallow)
+{
+  BTree<int> tree;
+  for (int i = 0; i < 1000000; ++i) tree.insert(i);
+  // Every non-root node holds at least Order / 2 - 1 keys, so the fan-out is at least Order / 2
+  EXPECT_LE(static_cast<double>(tree.getHeight()),
+            1 + std::log(1000000.0) / std::log(BTree<int>::order / 2.0));
+  EXPECT_EQ(tree.getMaximum(), 999999);
+}
+
+TEST(BTreeTest, RandomOperationsMatchMultiset)
+{
+  std::mt19937 rng(7);
+  BTree<int, 6> tree;
+  std::multiset<int> reference;
+  for (int step = 0; step < 50000; ++step) {
+    int key = static_cast<int>(rng() % 500);
+    if (rng() % 3) {
+      tree.insert(key);
+      reference.insert(key);
+    } else {
+      tree.deleteNode(key);
+      auto it = reference.find(key);
+      if (it != reference.end()) reference.erase(it);
+    }
+    ASSERT_EQ(tree.getSize(), reference.size());
+    if (step % 5000 == 0) {
+      std::vector<int> actual;
+      for (auto it = tree.cbegin(); it != tree.cend(); ++it) actual.push_back(*it);
+      ASSERT_EQ(actual, std::vector<int>(reference.begin(), reference.end()));
+    }
+  }
+  for (int key = 0; key < 500; ++key) EXPECT_EQ(tree.search(key), reference.count(key) > 0);
+
+  while (!reference.empty()) {
+    tree.deleteNode(*reference.begin());
+    reference.erase(reference.begin());
+  }
+  EXPECT_TRUE(tree.empty());
+  EXPECT_EQ(tree.getHeight(), 0);
+}
+
+TEST(BTreeTest, ReverseIteration)
+{
+  BTree<int, 4> tree;
+  for (int i = 0; i < 300; ++i) tree.insert(i);
+
+  auto it = tree.begin();
+  for (int i = 0; i < 299; ++i) ++it;
+  EXPECT_EQ(*it, 299);
+  for (int i = 299; i > 0; --i) EXPECT_EQ(*it--, i);
+  EXPECT_EQ(*it, 0);
+  --it;
+  EXPECT_TRUE(it == tree.end());
+}
+
+TEST(BTreeTest, CopyAndMove)
+{
+  BTree<std::string, 4> tree;
+  for (int i = 0; i < 100; ++i) tree.insert(std::to_string(i));
+
+  BTree<std::string, 4> copy(tree);
+  tree.deleteNode("50");
+  EXPECT_TRUE(copy.search("50"));
+  EXPECT_FALSE(tree.search("50"));
+
+  BTree<std::string, 4> moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(moved.getSize(), 100);
+
+  copy = tree;
+  EXPECT_EQ(copy.getSize(), 99);
+  moved = std::move(copy);
+  EXPECT_EQ(moved.getSize(), 99);
+  EXPECT_EQ(moved.getMinimum(), "0");
+  EXPECT_EQ(moved.getMaximum(), "99");
+}
+
+TEST(BTreeTest, InsertingKeyTakenFromTree)
+{
+  BTree<std::string, 4> tree;
+  for (const char * key : {"a", "b", "c"}) tree.insert(key);
+  // The root is full, so this insert splits it before storing the copy of "b"
+  tree.insert(*++tree.begin());
+  EXPECT_EQ(tree.getSize(), 4);
+  std::vector<std::string> keys;
+  for (auto it = tree.begin(); it != tree.end(); ++it) keys.push_back(*it);
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "b", "b", "c"}));
+}
+
+TEST(BTreeTest, ErasingKeyTakenFromTree)
+{
+  BTree<std::string, 4> tree;
+  for (const char * key : {"a", "b", "c", "d", "e", "f"}) tree.insert(key);
+  tree.deleteNode(*++tree.begin());
+  EXPECT_EQ(tree.getSize(), 5);
+  EXPECT_FALSE(tree.search("b"));
+  std::vector<std::string> keys;
+  for (auto it = tree.begin(); it != tree.end(); ++it) keys.push_back(*it);
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "c", "d", "e", "f"}));
+}
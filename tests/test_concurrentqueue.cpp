@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "../main.cpp"
+
+TEST(ConcurrentQueueTest, SingleThreadFifo)
+{
+  ConcurrentQueue<int> queue;
+  int value = -1;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.try_pop(value));
+
+  for (int i = 0; i < 1000; ++i) queue.push(i);
+  EXPECT_FALSE(queue.empty());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(ConcurrentQueueTest, NonTrivialElements)
+{
+  ConcurrentQueue<std::unique_ptr<std::string>> queue;
+  queue.push(std::make_unique<std::string>("first"));
+  queue.emplace(new std::string("second"));
+  queue.push(std::make_unique<std::string>("left behind"));
+
+  std::unique_ptr<std::string> out;
+  ASSERT_TRUE(queue.try_pop(out));
+  EXPECT_EQ(*out, "first");
+  ASSERT_TRUE(queue.try_pop(out));
+  EXPECT_EQ(*out, "second");
+  // The remaining element is released by the queue's destructor
+}
+
+// Counts live instances; moving from a poisoned one throws
+struct Fragile
+{
+  static int live;
+  bool poisoned;
+
+  explicit Fragile(bool poison = false) : poisoned(poison) { ++live; }
+  Fragile(const Fragile & other) : poisoned(other.poisoned) { ++live; }
+  Fragile & operator=(Fragile && other)
+  {
+    if (other.poisoned) throw std::runtime_error("poisoned");
+    poisoned = other.poisoned;
+    return *this;
+  }
+  ~Fragile() { --live; }
+};
+int Fragile::live = 0;
+
+TEST(ConcurrentQueueTest, ThrowingPopReleasesElement)
+{
+  {
+    ConcurrentQueue<Fragile> queue;
+    queue.emplace(true);
+    queue.emplace(false);
+    Fragile out;
+    EXPECT_THROW(queue.try_pop(out), std::runtime_error);
+    EXPECT_EQ(Fragile::live, 2);
+    EXPECT_TRUE(queue.try_pop(out));
+    EXPECT_FALSE(queue.try_pop(out));
+    EXPECT_EQ(Fragile::live, 1);
+  }
+  EXPECT_EQ(Fragile::live, 0);
+}
+
+TEST(ConcurrentQueueTest, MultiProducerMultiConsumerStress)
+{
+  const int producers = 4;
+  const int consumers = 4;
+  const int per_producer = 50000;
+
+  ConcurrentQueue<std::pair<int, int>> queue;
+  std::atomic<int> consumed(0);
+  std::vector<std::vector<int>> seen(consumers * producers);
+  std::vector<std::thread> threads;
+
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (int i = 0; i < per_producer; ++i) queue.push({p, i});
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&, c] {
+      std::pair<int, int> item;
+      while (consumed.load() < producers * per_producer) {
+        if (queue.try_pop(item)) {
+          seen[c * producers + item.first].push_back(item.second);
+          consumed.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto & thread : threads) thread.join();
+
+  std::pair<int, int> item;
+  EXPECT_FALSE(queue.try_pop(item));
+
+  std::vector<int> count(producers * per_producer, 0);
+  for (int c = 0; c < consumers; ++c) {
+    for (int p = 0; p < producers; ++p) {
+      const std::vector<int> & values = seen[c * producers + p];
+      // FIFO: each consumer sees any one producer's items in the order they were pushed
+      EXPECT_TRUE(std::is_sorted(values.begin(), values.end()));
+      for (int v : values) ++count[p * per_producer + v];
+    }
+  }
+  for (int n : count) ASSERT_EQ(n, 1);
+}
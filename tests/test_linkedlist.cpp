@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
 #include "../main.cpp"
 
 TEST(LinkedListTest, EmptyList)
@@ -73,12 +77,679 @@ TEST(LinkedListTest, PopBack)
   EXPECT_EQ(list.getSize(), 2);
 
   auto it = list.begin();
-  EXPECT_EQ(*it, 20);
-  ++it;
   EXPECT_EQ(*it, 10);
+  ++it;
+  EXPECT_EQ(*it, 20);
 
   list.pop_back();
   list.pop_back();
   EXPECT_EQ(list.getSize(), 0);
   EXPECT_TRUE(list.empty());
 }
+
+TEST(LinkedListTest, PoolAllocatorRecyclesNodes)
+{
+  LinkedList<int, PoolAllocator<int>> list;
+  for (int i = 0; i < 100; ++i) list.push_back(i);
+
+  std::vector<int *> addresses;
+  for (auto it = list.begin(); it != list.end(); ++it) addresses.push_back(&*it);
+
+  // Churn: every freed node should be handed straight back out
+  for (int round = 0; round < 1000; ++round) {
+    list.pop_front();
+    list.push_back(round);
+  }
+  EXPECT_EQ(list.getSize(), 100);
+  for (auto it = list.begin(); it != list.end(); ++it) {
+    EXPECT_NE(std::find(addresses.begin(), addresses.end(), &*it), addresses.end());
+  }
+
+  auto it = list.begin();
+  for (int i = 900; i < 1000; ++i, ++it) EXPECT_EQ(*it, i);
+}
+
+TEST(LinkedListTest, PoolAllocatorCopiesShareNothing)
+{
+  PoolAllocator<int> a;
+  PoolAllocator<int> b;
+  PoolAllocator<int> c(a);
+  EXPECT_TRUE(a == c);
+  EXPECT_FALSE(a == b);
+  EXPECT_FALSE(a == a.select_on_container_copy_construction());
+}
+
+TEST(LinkedListTest, PmrAllocator)
+{
+  char buffer[4096];
+  std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+  PmrLinkedList<int> list(&resource);
+  for (int i = 0; i < 50; ++i) list.push_front(i);
+  EXPECT_EQ(list.getSize(), 50);
+  EXPECT_EQ(*list.begin(), 49);
+  EXPECT_EQ(list.get_allocator().resource(), &resource);
+  while (!list.empty()) list.pop_back();
+}
+
+namespace
+{
+struct CopyCounter
+{
+  static int copies;
+  int value;
+  explicit CopyCounter(int v) : value(v) {}
+  CopyCounter(const CopyCounter & other) : value(other.value) { ++copies; }
+  CopyCounter(CopyCounter && other) noexcept : value(other.value) {}
+  CopyCounter & operator=(const CopyCounter & other)
+  {
+    value = other.value;
+    ++copies;
+    return *this;
+  }
+  CopyCounter & operator=(CopyCounter && other) noexcept
+  {
+    value = other.value;
+    return *this;
+  }
+};
+int CopyCounter::copies = 0;
+}  // namespace
+
+TEST(LinkedListTest, EmplaceAndRvalueInsertDoNotCopy)
+{
+  CopyCounter::copies = 0;
+  LinkedList<CopyCounter> list;
+  list.emplace_back(2);
+  list.emplace_front(1);
+  list.push_back(CopyCounter(3));
+  list.push_front(CopyCounter(0));
+  EXPECT_EQ(CopyCounter::copies, 0);
+  EXPECT_EQ(list.emplace_back(4).value, 4);
+
+  int expected = 0;
+  for (auto it = list.begin(); it != list.end(); ++it) EXPECT_EQ((*it).value, expected++);
+}
+
+TEST(LinkedListTest, CopyConstructionIsDeep)
+{
+  LinkedList<std::string> list;
+  list.push_back("a");
+  list.push_back("b");
+  list.push_back("c");
+
+  LinkedList<std::string> copy(list);
+  list.pop_front();
+  *list.begin() = "x";
+
+  EXPECT_EQ(copy.getSize(), 3);
+  std::vector<std::string> actual;
+  for (auto it = copy.begin(); it != copy.end(); ++it) actual.push_back(*it);
+  EXPECT_EQ(actual, (std::vector<std::string>{"a", "b", "c"}));
+  EXPECT_EQ(*copy.rbegin(), "c");
+}
+
+TEST(LinkedListTest, CopyAssignment)
+{
+  LinkedList<int> source;
+  for (int i = 0; i < 5; ++i) source.push_back(i);
+
+  LinkedList<int> longer;
+  for (int i = 0; i < 10; ++i) longer.push_back(-i);
+  longer = source;
+  EXPECT_EQ(longer.getSize(), 5);
+  EXPECT_EQ(*longer.rbegin(), 4);
+
+  LinkedList<int> shorter;
+  shorter.push_back(42);
+  shorter = source;
+  EXPECT_EQ(shorter.getSize(), 5);
+  int expected = 0;
+  for (auto it = shorter.begin(); it != shorter.end(); ++it) EXPECT_EQ(*it, expected++);
+
+  shorter = shorter;
+  EXPECT_EQ(shorter.getSize(), 5);
+}
+
+TEST(LinkedListTest, MoveStealsNodes)
+{
+  LinkedList<int> list;
+  for (int i = 0; i < 3; ++i) list.push_back(i);
+  int * first = &*list.begin();
+
+  LinkedList<int> moved(std::move(list));
+  EXPECT_TRUE(list.empty());
+  EXPECT_EQ(moved.getSize(), 3);
+  EXPECT_EQ(&*moved.begin(), first);
+
+  LinkedList<int> assigned;
+  assigned.push_back(99);
+  assigned = std::move(moved);
+  EXPECT_TRUE(moved.empty());
+  EXPECT_EQ(assigned.getSize(), 3);
+  EXPECT_EQ(&*assigned.begin(), first);
+
+  // Moved-from lists stay usable
+  moved.push_back(7);
+  EXPECT_EQ(*moved.begin(), 7);
+}
+
+TEST(LinkedListTest, MoveAssignmentWithUnequalAllocators)
+{
+  std::pmr::unsynchronized_pool_resource a;
+  std::pmr::unsynchronized_pool_resource b;
+  PmrLinkedList<std::string> source(&a);
+  source.push_back("one");
+  source.push_back("two");
+  PmrLinkedList<std::string> target(&b);
+  target = std::move(source);
+
+  EXPECT_EQ(target.get_allocator().resource(), &b);
+  EXPECT_EQ(target.getSize(), 2);
+  EXPECT_EQ(*target.begin(), "one");
+  EXPECT_TRUE(source.empty());
+}
+
+// Reads the list forwards and checks that walking it backwards gives the same elements
+template <typename List>
+std::vector<typename List::iterator> checkedNodes(List & list)
+{
+  std::vector<typename List::iterator> forward;
+  for (auto it = list.begin(); it != list.end(); ++it) forward.push_back(it);
+  EXPECT_EQ(forward.size(), list.getSize());
+  size_t i = forward.size();
+  for (auto it = list.rbegin(); it != list.rend(); ++it) EXPECT_EQ(&*it, &*forward[--i]);
+  EXPECT_EQ(i, 0);
+  return forward;
+}
+
+TEST(LinkedListTest, SortIsStableAndKeepsNodes)
+{
+  std::mt19937 rng(19);
+  for (size_t n : {0, 1, 2, 3, 7, 64, 1000, 4099}) {
+    LinkedList<std::pair<int, size_t>> list;
+    std::vector<std::pair<int, size_t>> expected;
+    for (size_t i = 0; i < n; ++i) {
+      expected.push_back({static_cast<int>(rng() % 50), i});
+      list.push_back(expected.back());
+    }
+    std::vector<const std::pair<int, size_t> *> addresses;
+    for (auto & value : list) addresses.push_back(&value);
+
+    auto byKey = [](const auto & a, const auto & b) { return a.first < b.first; };
+    list.sort(byKey);
+    std::stable_sort(expected.begin(), expected.end(), byKey);
+
+    auto nodes = checkedNodes(list);
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(*nodes[i], expected[i]);
+      EXPECT_EQ(&*nodes[i], addresses[expected[i].second]);
+    }
+  }
+
+  LinkedList<int> descending;
+  for (int i = 0; i < 100; ++i) descending.push_back(i);
+  descending.sort(std::greater<>());
+  EXPECT_EQ(*descending.begin(), 99);
+  EXPECT_EQ(*descending.rbegin(), 0);
+}
+
+TEST(LinkedListTest, ParallelSortMatchesSort)
+{
+  std::mt19937 rng(23);
+  for (unsigned threads : {1u, 2u, 4u, 7u}) {
+    LinkedList<int, std::allocator<int>, CountingStats> list;
+    std::vector<int> expected;
+    for (int i = 0; i < 100000; ++i) {
+      int v = static_cast<int>(rng() % 1000);
+      list.push_back(v);
+      expected.push_back(v);
+    }
+    list.reset_stats();
+    list.parallel_sort(std::less<>(), threads);
+    std::sort(expected.begin(), expected.end());
+
+    auto nodes = checkedNodes(list);
+    for (size_t i = 0; i < expected.size(); ++i) ASSERT_EQ(*nodes[i], expected[i]);
+    EXPECT_EQ(list.stats().allocations, 0);
+  }
+}
+
+TEST(LinkedListTest, MergeSortedLists)
+{
+  LinkedList<std::pair<int, char>> a;
+  LinkedList<std::pair<int, char>> b;
+  for (int v : {1, 3, 3, 8}) a.push_back({v, 'a'});
+  for (int v : {0, 3, 9, 10}) b.push_back({v, 'b'});
+  const auto * moved = &*b.begin();
+
+  auto byKey = [](const auto & x, const auto & y) { return x.first < y.first; };
+  a.merge(b, byKey);
+  EXPECT_TRUE(b.empty());
+  std::vector<std::pair<int, char>> expected = {{0, 'b'}, {1, 'a'}, {3, 'a'}, {3, 'a'},
+                                                {3, 'b'}, {8, 'a'}, {9, 'b'}, {10, 'b'}};
+  auto nodes = checkedNodes(a);
+  ASSERT_EQ(nodes.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) EXPECT_EQ(*nodes[i], expected[i]);
+  EXPECT_EQ(&*nodes[0], moved);
+
+  a.merge(b, byKey);
+  EXPECT_EQ(a.getSize(), expected.size());
+  LinkedList<std::pair<int, char>> empty;
+  empty.merge(std::move(a), byKey);
+  EXPECT_EQ(empty.getSize(), expected.size());
+  EXPECT_TRUE(a.empty());
+}
+
+TEST(LinkedListTest, MergeWithUnequalAllocators)
+{
+  std::pmr::unsynchronized_pool_resource a;
+  std::pmr::unsynchronized_pool_resource b;
+  PmrLinkedList<std::string> target(&a);
+  PmrLinkedList<std::string> source(&b);
+  for (const char * s : {"b", "d"}) target.push_back(s);
+  for (const char * s : {"a", "c", "e"}) source.push_back(s);
+
+  target.merge(source);
+  EXPECT_TRUE(source.empty());
+  EXPECT_EQ(target.get_allocator().resource(), &a);
+  std::string joined;
+  for (const auto & s : target) joined += s;
+  EXPECT_EQ(joined, "abcde");
+  checkedNodes(target);
+}
+
+// Iterator n steps away from it; end() has no predecessor, so count from begin() instead
+template <typename Iterator>
+Iterator stepped(Iterator it, long n)
+{
+  for (; n > 0; --n) ++it;
+  for (; n < 0; ++n) --it;
+  return it;
+}
+
+// Elements front to back, after checking the links both ways
+template <typename List>
+auto valuesOf(List & list)
+{
+  std::vector<std::decay_t<decltype(*list.begin())>> values;
+  for (auto it : checkedNodes(list)) values.push_back(*it);
+  return values;
+}
+
+TEST(LinkedListTest, InsertAndEraseAtPositions)
+{
+  LinkedList<int, std::allocator<int>, CountingStats> list;
+  auto it = list.insert(list.end(), 3);
+  list.insert(it, 1);
+  list.insert(list.end(), 5);
+  EXPECT_EQ(*list.insert(it, 2), 2);
+  list.emplace(list.begin(), 0);
+  it = list.insert(stepped(list.begin(), 4), 4);
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{0, 1, 2, 3, 4, 5}));
+
+  it = list.erase(stepped(it, -1));
+  EXPECT_EQ(*it, 4);
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{0, 1, 2, 4, 5}));
+  EXPECT_EQ(*list.erase(list.begin()), 1);
+  EXPECT_TRUE(list.erase(stepped(list.begin(), 3)) == list.end());
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{1, 2, 4}));
+  EXPECT_THROW(list.erase(list.end()), std::out_of_range);
+
+  for (int i = 5; i < 10; ++i) list.push_back(i);
+  it = list.erase(stepped(list.begin(), 1), stepped(list.begin(), 4));
+  EXPECT_EQ(*it, 6);
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{1, 6, 7, 8, 9}));
+  EXPECT_TRUE(list.erase(stepped(list.begin(), 2), list.end()) == list.end());
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{1, 6}));
+  list.erase(list.begin(), list.end());
+  EXPECT_TRUE(list.empty());
+  checkedNodes(list);
+
+  CountingStats stats = list.stats();
+  EXPECT_EQ(stats.pushes, 11);
+  EXPECT_EQ(stats.pops, 11);
+  EXPECT_EQ(stats.allocations, stats.frees);
+}
+
+TEST(LinkedListTest, SpliceRelinksNodes)
+{
+  using List = LinkedList<int, std::allocator<int>, CountingStats>;
+  List a;
+  List b;
+  for (int i = 0; i < 5; ++i) a.push_back(i);
+  for (int i = 10; i < 15; ++i) b.push_back(i);
+  const int * eleven = &*stepped(b.begin(), 1);
+  a.reset_stats();
+  b.reset_stats();
+
+  // A single element, then a range, then the rest of b
+  a.splice(stepped(a.begin(), 1), b, stepped(b.begin(), 1));
+  EXPECT_EQ(&*stepped(a.begin(), 1), eleven);
+  a.splice(a.end(), b, stepped(b.begin(), 1), stepped(b.begin(), 3));
+  EXPECT_EQ(valuesOf(a), (std::vector<int>{0, 11, 1, 2, 3, 4, 12, 13}));
+  EXPECT_EQ(valuesOf(b), (std::vector<int>{10, 14}));
+  a.splice(a.begin(), b);
+  EXPECT_TRUE(b.empty());
+  checkedNodes(b);
+  EXPECT_EQ(valuesOf(a), (std::vector<int>{10, 14, 0, 11, 1, 2, 3, 4, 12, 13}));
+
+  // Within one list: rotate the first three elements to the back, then move one forward
+  a.splice(a.end(), a, a.begin(), stepped(a.begin(), 3));
+  EXPECT_EQ(valuesOf(a), (std::vector<int>{11, 1, 2, 3, 4, 12, 13, 10, 14, 0}));
+  a.splice(a.begin(), a, stepped(a.begin(), a.getSize() - 1));
+  a.splice(a.begin(), a, a.begin());
+  a.splice(stepped(a.begin(), 1), a, stepped(a.begin(), 1));
+  EXPECT_EQ(valuesOf(a), (std::vector<int>{0, 11, 1, 2, 3, 4, 12, 13, 10, 14}));
+  EXPECT_EQ(a.getSize(), 10u);
+
+  // A tail element of another list moves to the back
+  b.splice(b.end(), a, stepped(a.begin(), a.getSize() - 1));
+  EXPECT_EQ(valuesOf(b), (std::vector<int>{14}));
+  EXPECT_EQ(a.getSize(), 9u);
+
+  EXPECT_EQ(a.stats().allocations, 0);
+  EXPECT_EQ(a.stats().frees, 0);
+  EXPECT_EQ(b.stats().allocations, 0);
+  // Elements changing lists count as pops and pushes; moves within a list do not
+  EXPECT_EQ(a.stats().pushes, 5);
+  EXPECT_EQ(a.stats().pops, 1);
+  EXPECT_EQ(b.stats().pushes, 1);
+  EXPECT_EQ(b.stats().pops, 5);
+}
+
+TEST(LinkedListTest, SpliceWithUnequalAllocators)
+{
+  std::pmr::unsynchronized_pool_resource a;
+  std::pmr::unsynchronized_pool_resource b;
+  PmrLinkedList<std::string> target(&a);
+  PmrLinkedList<std::string> source(&b);
+  for (const char * s : {"a", "e"}) target.push_back(s);
+  for (const char * s : {"b", "c", "d", "f", "g"}) source.push_back(s);
+
+  target.splice(stepped(target.begin(), 1), source, source.begin(), stepped(source.begin(), 3));
+  target.splice(target.end(), source, source.begin());
+  target.splice(target.end(), std::move(source));
+  EXPECT_TRUE(source.empty());
+  EXPECT_EQ(target.get_allocator().resource(), &a);
+  std::string joined;
+  for (const auto & s : valuesOf(target)) joined += s;
+  EXPECT_EQ(joined, "abcdefg");
+}
+
+TEST(LinkedListTest, RemoveIf)
+{
+  LinkedList<int> list;
+  for (int i = 0; i < 20; ++i) list.push_back(i);
+  int * seven = &*stepped(list.begin(), 7);
+  EXPECT_EQ(list.remove_if([](int v) { return v % 2 == 0; }), 10u);
+  EXPECT_EQ(valuesOf(list), (std::vector<int>{1, 3, 5, 7, 9, 11, 13, 15, 17, 19}));
+  EXPECT_EQ(&*stepped(list.begin(), 3), seven);
+
+  EXPECT_EQ(list.remove_if([](int v) { return v == 1 || v == 19; }), 2u);
+  EXPECT_EQ(*list.begin(), 3);
+  EXPECT_EQ(*list.rbegin(), 17);
+  EXPECT_EQ(list.remove_if([](int) { return false; }), 0u);
+  EXPECT_EQ(list.remove_if([](int) { return true; }), 8u);
+  EXPECT_TRUE(list.empty());
+  checkedNodes(list);
+}
+
+struct Reading
+{
+  int sensor;
+  double value;
+  bool operator==(const Reading & other) const
+  {
+    return sensor == other.sensor && value == other.value;
+  }
+  bool operator<(const Reading & other) const
+  {
+    return sensor < other.sensor || (sensor == other.sensor && value < other.value);
+  }
+};
+
+TEST(LinkedListTest, SnapshotRoundTrip)
+{
+  const std::string path = ::testing::TempDir() + "algopack_list.snapshot";
+  LinkedList<Reading> list;
+  for (int i = 0; i < 20000; ++i) list.push_back({(i * 7919) % 1000, i / 4.0});
+  list.save(path);
+
+  auto loaded = LinkedList<Reading>::load(path);
+  ASSERT_EQ(loaded.getSize(), list.getSize());
+  auto it = list.cbegin();
+  for (const Reading & reading : loaded) EXPECT_TRUE(reading == *it++);
+
+  SnapshotView<Reading> view(path);
+  EXPECT_FALSE(view.sorted());
+  EXPECT_TRUE(view[3] == (Reading{3 * 7919 % 1000, 0.75}));
+  EXPECT_TRUE(view.search({0, 0.0}));
+  EXPECT_FALSE(view.search({0, 0.1}));
+
+  LinkedList<int> empty;
+  empty.save(path);
+  EXPECT_TRUE(LinkedList<int>::load(path).empty());
+  std::remove(path.c_str());
+}
+
+TEST(UnrolledLinkedListTest, PushPopBothEnds)
+{
+  UnrolledLinkedList<int> list;
+  EXPECT_TRUE(list.empty());
+  EXPECT_THROW(list.pop_back(), std::out_of_range);
+  EXPECT_THROW(list.pop_front(), std::out_of_range);
+
+  const int n = 10 * static_cast<int>(UnrolledLinkedList<int>::capacity) + 3;
+  for (int i = 0; i < n; ++i) list.push_back(i);
+  for (int i = 1; i <= n; ++i) list.push_front(-i);
+  EXPECT_EQ(list.getSize(), 2 * static_cast<size_t>(n));
+
+  int expected = -n;
+  for (auto it = list.begin(); it != list.end(); ++it) EXPECT_EQ(*it, expected++);
+  EXPECT_EQ(expected, n);
+
+  expected = n - 1;
+  for (auto it = list.crbegin(); it != list.crend(); ++it) EXPECT_EQ(*it, expected--);
+
+  for (int i = 0; i < n; ++i) list.pop_front();
+  for (int i = 0; i < n / 2; ++i) list.pop_back();
+  EXPECT_EQ(list.getSize(), static_cast<size_t>(n - n / 2));
+  EXPECT_EQ(*list.begin(), 0);
+  EXPECT_EQ(*list.rbegin(), n - n / 2 - 1);
+
+  while (!list.empty()) list.pop_back();
+  EXPECT_TRUE(list.begin() == list.end());
+}
+
+TEST(UnrolledLinkedListTest, BidirectionalIterators)
+{
+  UnrolledLinkedList<long> list;
+  const long n = 3 * static_cast<long>(UnrolledLinkedList<long>::capacity);
+  for (long i = 0; i < n; ++i) list.push_back(i);
+
+  auto it = list.begin();
+  for (long i = 0; i < n - 1; ++i) ++it;
+  EXPECT_EQ(*it, n - 1);
+  for (long i = n - 1; i > 0; --i) EXPECT_EQ(*it--, i);
+  EXPECT_EQ(*it, 0);
+
+  auto rit = list.rbegin();
+  ++rit;
+  --rit;
+  EXPECT_EQ(*rit, n - 1);
+  *rit = 42;
+  EXPECT_EQ(*list.crbegin(), 42);
+}
+
+TEST(UnrolledLinkedListTest, NonTrivialElementsCopyAndMove)
+{
+  UnrolledLinkedList<std::string> list;
+  for (int i = 0; i < 100; ++i) list.emplace_back(std::to_string(i));
+  list.emplace_front("front");
+
+  UnrolledLinkedList<std::string> copy(list);
+  list.pop_front();
+  EXPECT_EQ(*copy.begin(), "front");
+  EXPECT_EQ(copy.getSize(), 101);
+
+  UnrolledLinkedList<std::string> moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(*moved.rbegin(), "99");
+
+  copy = moved;
+  EXPECT_EQ(copy.getSize(), 101);
+  moved = std::move(list);
+  EXPECT_EQ(*moved.begin(), "0");
+}
+
+TEST(LinkedListTest, CountingStatsTrackPushesAndPops)
+{
+  static_assert(sizeof(LinkedList<int>) ==
+                sizeof(LinkedList<int, std::allocator<int>, NoStats>));
+
+  LinkedList<int, std::allocator<int>, CountingStats> list;
+  for (int i = 0; i < 10; ++i) list.push_back(i);
+  list.push_front(-1);
+  list.pop_back();
+  list.pop_front();
+  CountingStats stats = list.stats();
+  EXPECT_EQ(stats.pushes, 11);
+  EXPECT_EQ(stats.pops, 2);
+  EXPECT_EQ(stats.allocations, 11);
+  EXPECT_EQ(stats.frees, 2);
+
+  list.reset_stats();
+  EXPECT_EQ(list.stats().pushes, 0);
+
+  LinkedList<int, std::allocator<int>, CountingStats> other;
+  other.push_back(5);
+  other.push_back(100);
+  other.reset_stats();
+  list.merge(other);
+  EXPECT_EQ(list.stats().pushes, 2);
+  EXPECT_EQ(other.stats().pops, 2);
+  EXPECT_EQ(list.stats().allocations, 0);
+}
+
+struct ReadyTag;
+
+// Lives in a run queue through its base hook and in a ready list through a tagged base hook,
+// and in an owner's list through its member hook
+struct Task : IntrusiveListHook<>, IntrusiveListHook<ReadyTag>
+{
+  int id;
+  IntrusiveListHook<> owner;
+  explicit Task(int id) : id(id) {}
+};
+
+using RunQueue = IntrusiveList<Task>;
+using ReadyList = IntrusiveList<Task, IntrusiveBaseHook<Task, ReadyTag>>;
+using OwnedList = IntrusiveList<Task, IntrusiveMemberHook<Task, &Task::owner>>;
+
+template <typename List>
+std::vector<int> idsOf(List & list)
+{
+  std::vector<int> ids;
+  for (auto it = list.cbegin(); it != list.cend(); ++it) ids.push_back(it->id);
+  std::vector<int> backwards;
+  for (auto it = list.crbegin(); it != list.crend(); ++it) backwards.push_back(it->id);
+  std::reverse(backwards.begin(), backwards.end());
+  EXPECT_EQ(ids, backwards);
+  EXPECT_EQ(ids.size(), list.getSize());
+  return ids;
+}
+
+TEST(IntrusiveListTest, PushPopAndIterate)
+{
+  std::vector<Task> tasks;
+  for (int i = 0; i < 6; ++i) tasks.emplace_back(i);
+
+  RunQueue queue;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_THROW(queue.pop_front(), std::out_of_range);
+  EXPECT_THROW(queue.front(), std::out_of_range);
+
+  for (int i = 1; i < 5; ++i) queue.push_back(tasks[i]);
+  queue.push_front(tasks[0]);
+  queue.insert(queue.end(), tasks[5]);
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(&queue.front(), &tasks[0]);
+  EXPECT_EQ(&queue.back(), &tasks[5]);
+  EXPECT_EQ(&*--queue.end(), &tasks[5]);
+  EXPECT_THROW(queue.push_back(tasks[3]), std::invalid_argument);
+
+  queue.pop_front();
+  queue.pop_back();
+  EXPECT_FALSE(static_cast<IntrusiveListHook<> &>(tasks[0]).is_linked());
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{1, 2, 3, 4}));
+
+  for (Task & task : queue) task.id *= 10;
+  EXPECT_EQ(tasks[2].id, 20);
+}
+
+TEST(IntrusiveListTest, EraseAnywhereInConstantTime)
+{
+  std::vector<Task> tasks;
+  for (int i = 0; i < 5; ++i) tasks.emplace_back(i);
+  RunQueue queue;
+  for (Task & task : tasks) queue.push_back(task);
+
+  auto next = queue.erase(tasks[2]);
+  EXPECT_EQ(next->id, 3);
+  EXPECT_THROW(queue.erase(tasks[2]), std::invalid_argument);
+  queue.erase(queue.iterator_to(tasks[0]));
+  queue.erase(tasks[4]);
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{1, 3}));
+
+  queue.insert(queue.iterator_to(tasks[3]), tasks[2]);
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{1, 2, 3}));
+}
+
+TEST(IntrusiveListTest, ObjectInSeveralListsAtOnce)
+{
+  std::vector<Task> tasks;
+  for (int i = 0; i < 6; ++i) tasks.emplace_back(i);
+  RunQueue queue;
+  ReadyList ready;
+  OwnedList owned;
+  for (Task & task : tasks) queue.push_back(task);
+  for (int i = 5; i >= 0; i -= 2) ready.push_back(tasks[i]);
+  for (int i = 0; i < 6; i += 3) owned.push_front(tasks[i]);
+
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(idsOf(ready), (std::vector<int>{5, 3, 1}));
+  EXPECT_EQ(idsOf(owned), (std::vector<int>{3, 0}));
+
+  ready.erase(tasks[3]);
+  owned.erase(tasks[3]);
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(idsOf(ready), (std::vector<int>{5, 1}));
+  EXPECT_EQ(idsOf(owned), (std::vector<int>{0}));
+}
+
+TEST(IntrusiveListTest, MoveAndClearLeaveObjectsUnlinked)
+{
+  std::vector<Task> tasks;
+  for (int i = 0; i < 4; ++i) tasks.emplace_back(i);
+  RunQueue queue;
+  for (Task & task : tasks) queue.push_back(task);
+
+  RunQueue moved(std::move(queue));
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(idsOf(moved), (std::vector<int>{0, 1, 2, 3}));
+
+  Task copy = tasks[1];
+  EXPECT_FALSE(static_cast<IntrusiveListHook<> &>(copy).is_linked());
+
+  queue = std::move(moved);
+  EXPECT_EQ(idsOf(queue), (std::vector<int>{0, 1, 2, 3}));
+  queue.clear();
+  EXPECT_TRUE(queue.empty());
+  for (Task & task : tasks) EXPECT_FALSE(static_cast<IntrusiveListHook<> &>(task).is_linked());
+
+  {
+    RunQueue scoped;
+    scoped.push_back(tasks[0]);
+  }
+  EXPECT_FALSE(static_cast<IntrusiveListHook<> &>(tasks[0]).is_linked());
+}
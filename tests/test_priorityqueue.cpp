@@ -0,0 +1,389 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "../main.cpp"
+
+template <size_t D>
+static void checkHeapSort()
+{
+  std::mt19937 rng(D);
+  std::vector<int> values;
+  for (int i = 0; i < 5000; ++i) values.push_back(static_cast<int>(rng() % 1000));
+  PriorityQueue<int, std::less<int>, D> queue;
+  for (int v : values) queue.push(v);
+  EXPECT_EQ(queue.getSize(), values.size());
+
+  std::sort(values.begin(), values.end());
+  std::vector<int> popped;
+  while (!queue.empty()) {
+    popped.push_back(queue.top());
+    queue.pop();
+  }
+  EXPECT_EQ(popped, values);
+}
+
+TEST(PriorityQueueTest, PopsInOrderForEveryArity)
+{
+  checkHeapSort<2>();
+  checkHeapSort<3>();
+  checkHeapSort<4>();
+  checkHeapSort<8>();
+  checkHeapSort<16>();
+}
+
+TEST(PriorityQueueTest, EmptyQueue)
+{
+  PriorityQueue<int> queue;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(queue.getSize(), 0u);
+  EXPECT_THROW(queue.top(), std::out_of_range);
+  EXPECT_THROW(queue.pop(), std::out_of_range);
+  queue.push(1);
+  queue.pop();
+  EXPECT_THROW(queue.pop(), std::out_of_range);
+}
+
+TEST(PriorityQueueTest, CustomComparatorMakesMaxHeap)
+{
+  PriorityQueue<int, std::greater<int>> queue;
+  for (int v : {5, 1, 9, 3, 7}) queue.push(v);
+  std::vector<int> popped;
+  while (!queue.empty()) {
+    popped.push_back(queue.top());
+    queue.pop();
+  }
+  EXPECT_EQ(popped, (std::vector<int>{9, 7, 5, 3, 1}));
+}
+
+TEST(PriorityQueueTest, BulkConstruction)
+{
+  std::vector<int> values;
+  for (int i = 0; i < 10000; ++i) values.push_back((i * 7919) % 10007);
+  PriorityQueue<int> queue(values.begin(), values.end());
+  EXPECT_EQ(queue.getSize(), values.size());
+
+  std::vector<PriorityQueue<int>::handle> handles;
+  queue.assign(values.begin(), values.end(), handles);
+  ASSERT_EQ(handles.size(), values.size());
+  for (size_t i = 0; i < values.size(); i += 97) EXPECT_EQ(queue.get(handles[i]), values[i]);
+
+  std::sort(values.begin(), values.end());
+  for (int v : values) {
+    ASSERT_EQ(queue.top(), v);
+    queue.pop();
+  }
+  EXPECT_TRUE(queue.empty());
+
+  std::vector<int> none;
+  queue.assign(none.begin(), none.end());
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(PriorityQueueTest, HandlesSupportDecreaseKeyUpdateAndErase)
+{
+  // Mirrors every operation on a multiset to check the heap order, and reads every value
+  // back through its handle to check that handles follow their elements as the heap moves
+  std::mt19937 rng(21);
+  using Queue = PriorityQueue<int, std::less<int>, 3>;
+  Queue queue;
+  std::vector<Queue::handle> live;
+  std::multiset<int> reference;
+
+  for (int step = 0; step < 50000; ++step) {
+    unsigned action = rng() % 6;
+    if (action <= 1 || live.empty()) {
+      int v = static_cast<int>(rng() % 100000);
+      live.push_back(queue.push(v));
+      reference.insert(v);
+    } else if (action == 5) {
+      auto it = std::find(live.begin(), live.end(), queue.top_handle());
+      ASSERT_TRUE(it != live.end());
+      queue.pop();
+      reference.erase(reference.begin());
+      *it = live.back();
+      live.pop_back();
+    } else {
+      size_t pick = rng() % live.size();
+      Queue::handle h = live[pick];
+      reference.erase(reference.find(queue.get(h)));
+      if (action == 2) {
+        int v = queue.get(h) - static_cast<int>(rng() % 1000);
+        queue.decrease_key(h, v);
+        reference.insert(v);
+        EXPECT_EQ(queue.get(h), v);
+      } else if (action == 3) {
+        int v = static_cast<int>(rng() % 100000);
+        queue.update(h, v);
+        reference.insert(v);
+        EXPECT_EQ(queue.get(h), v);
+      } else {
+        queue.erase(h);
+        live[pick] = live.back();
+        live.pop_back();
+      }
+    }
+    ASSERT_EQ(queue.getSize(), reference.size());
+    if (!reference.empty()) {
+      ASSERT_EQ(queue.top(), *reference.begin());
+    }
+  }
+
+  std::multiset<int> viaHandles;
+  for (Queue::handle h : live) viaHandles.insert(queue.get(h));
+  EXPECT_EQ(viaHandles, reference);
+}
+
+TEST(PriorityQueueTest, MoveOnlyElements)
+{
+  auto byValue = [](const std::unique_ptr<int> & a, const std::unique_ptr<int> & b) {
+    return *a < *b;
+  };
+  PriorityQueue<std::unique_ptr<int>, decltype(byValue)> queue(byValue);
+  for (int v : {4, 2, 8, 6}) queue.push(std::make_unique<int>(v));
+  auto h = queue.emplace(new int(5));
+  queue.erase(h);
+  std::vector<int> popped;
+  while (!queue.empty()) {
+    popped.push_back(*queue.top());
+    queue.pop();
+  }
+  EXPECT_EQ(popped, (std::vector<int>{2, 4, 6, 8}));
+
+  std::unique_ptr<int> out;
+  queue.push(std::make_unique<int>(1));
+  queue.pop(out);
+  EXPECT_EQ(*out, 1);
+  EXPECT_THROW(queue.pop(out), std::out_of_range);
+}
+
+TEST(MultiQueueTest, SingleThreadPopsEverythingRoughlyInOrder)
+{
+  MultiQueue<int> queue(4, 2);
+  EXPECT_EQ(queue.shardCount(), 8u);
+  int value = -1;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.try_pop(value));
+
+  const int n = 20000;
+  for (int i = 0; i < n; ++i) queue.push((i * 7919) % n);
+  EXPECT_FALSE(queue.empty());
+
+  // Each pop takes the better of two shard tops, so popped values stay near the front of
+  // the remaining ones even though they are not exactly in order
+  std::vector<bool> popped(n, false);
+  int smallestLeft = 0;
+  long long totalRankError = 0;
+  for (int i = 0; i < n; ++i) {
+    ASSERT_TRUE(queue.try_pop(value));
+    ASSERT_FALSE(popped[value]);
+    popped[value] = true;
+    totalRankError += value - smallestLeft;
+    while (smallestLeft < n && popped[smallestLeft]) ++smallestLeft;
+  }
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_TRUE(queue.empty());
+  EXPECT_LT(totalRankError / n, 8 * static_cast<long long>(queue.shardCount()));
+}
+
+TEST(MultiQueueTest, ConcurrentPushAndPopDeliverEveryElementOnce)
+{
+  const int threads = 4;
+  const int per_thread = 50000;
+  MultiQueue<int> queue(threads);
+  std::atomic<int> consumed(0);
+  std::vector<std::vector<int>> seen(threads);
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      int value;
+      // Every worker both produces and consumes, like scheduler threads spawning tasks
+      for (int i = 0; i < per_thread; ++i) {
+        queue.push(t * per_thread + i);
+        if (i % 2 && queue.try_pop(value)) {
+          seen[t].push_back(value);
+          consumed.fetch_add(1);
+        }
+      }
+      while (consumed.load() < threads * per_thread) {
+        if (queue.try_pop(value)) {
+          seen[t].push_back(value);
+          consumed.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread & worker : workers) worker.join();
+
+  int value;
+  EXPECT_FALSE(queue.try_pop(value));
+  std::vector<int> count(threads * per_thread, 0);
+  for (const std::vector<int> & values : seen)
+    for (int v : values) ++count[v];
+  for (int c : count) ASSERT_EQ(c, 1);
+}
+
+template <typename Queue>
+static void checkMonotoneQueue(Queue & queue, std::uint64_t maxStep, unsigned seed)
+{
+  // Interleaves pushes of keys at or above the last popped one with pops, checking each
+  // popped key against a multimap and that every value comes out exactly once
+  std::mt19937_64 rng(seed);
+  std::multimap<std::uint64_t, int> reference;
+  std::uint64_t lastPopped = 0;
+  int next = 0;
+  std::vector<bool> seen;
+  for (int step = 0; step < 100000; ++step) {
+    if (reference.empty() || rng() % 3) {
+      std::uint64_t key = lastPopped + rng() % (maxStep + 1);
+      queue.push(key, next);
+      reference.emplace(key, next);
+      seen.push_back(false);
+      ++next;
+    } else {
+      std::uint64_t key;
+      int value;
+      queue.pop(key, value);
+      ASSERT_EQ(key, reference.begin()->first);
+      ASSERT_FALSE(seen[value]);
+      seen[value] = true;
+      auto range = reference.equal_range(key);
+      auto it = std::find_if(range.first, range.second, [value](auto & e) {
+        return e.second == value;
+      });
+      ASSERT_TRUE(it != range.second);
+      reference.erase(it);
+      lastPopped = key;
+    }
+    ASSERT_EQ(queue.getSize(), reference.size());
+  }
+}
+
+TEST(RadixHeapTest, MatchesMultimapOnMonotoneWorkload)
+{
+  RadixHeap<std::uint64_t, int> small;
+  checkMonotoneQueue(small, 100, 1);
+  RadixHeap<std::uint64_t, int> wide;
+  checkMonotoneQueue(wide, std::uint64_t(1) << 40, 2);
+}
+
+TEST(RadixHeapTest, RejectsKeysBelowTheLastPopped)
+{
+  RadixHeap<std::uint32_t, std::string> heap;
+  std::uint32_t key;
+  std::string value;
+  EXPECT_THROW(heap.pop(key, value), std::out_of_range);
+  heap.push(10, "ten");
+  heap.push(4000000000u, "big");
+  heap.emplace(10, 3, 'x');
+  heap.pop(key, value);
+  EXPECT_EQ(key, 10u);
+  heap.pop(key, value);
+  EXPECT_EQ(key, 10u);
+  EXPECT_EQ(heap.lastKey(), 10u);
+  EXPECT_THROW(heap.push(9, "nine"), std::out_of_range);
+  heap.push(10, "again");
+  heap.pop(key, value);
+  EXPECT_EQ(value, "again");
+  heap.pop(key, value);
+  EXPECT_EQ(key, 4000000000u);
+  EXPECT_EQ(value, "big");
+  EXPECT_TRUE(heap.empty());
+  heap.push(1, "restart");
+  heap.pop(key, value);
+  EXPECT_EQ(key, 1u);
+}
+
+TEST(BucketQueueTest, MatchesMultimapOnMonotoneWorkload)
+{
+  BucketQueue<std::uint64_t, int> queue(100);
+  checkMonotoneQueue(queue, 100, 3);
+}
+
+TEST(BucketQueueTest, RejectsKeysOutsideTheWindow)
+{
+  BucketQueue<unsigned, int> queue(10);
+  unsigned key;
+  int value;
+  EXPECT_THROW(queue.pop(key, value), std::out_of_range);
+  queue.push(15, 1);  // outside [0, 10], so the empty queue moves its window to 15
+  EXPECT_THROW(queue.push(14, 0), std::out_of_range);
+  EXPECT_THROW(queue.push(26, 0), std::out_of_range);
+  queue.push(25, 2);
+  queue.push(17, 3);
+  queue.pop(key, value);
+  EXPECT_EQ(key, 15u);
+  queue.pop(key, value);
+  EXPECT_EQ(key, 17u);
+  queue.push(27, 4);
+  EXPECT_THROW(queue.push(28, 0), std::out_of_range);
+  EXPECT_THROW(queue.push(16, 0), std::out_of_range);
+  queue.pop(key, value);
+  EXPECT_EQ(value, 2);
+  queue.pop(key, value);
+  EXPECT_EQ(value, 4);
+
+  queue.push(5, 5);
+  queue.pop(key, value);
+  EXPECT_EQ(key, 5u);
+}
+
+TEST(MonotoneQueueTest, DijkstraAgreesWithBinaryHeap)
+{
+  // Random graph with small integer weights; all three queues must give the same distances
+  const unsigned n = 2000;
+  const unsigned maxWeight = 50;
+  std::mt19937 rng(17);
+  std::vector<std::vector<std::pair<unsigned, unsigned>>> edges(n);
+  for (unsigned u = 0; u < n; ++u)
+    for (int e = 0; e < 8; ++e) edges[u].push_back({rng() % n, 1 + rng() % maxWeight});
+
+  const unsigned unreached = std::numeric_limits<unsigned>::max();
+  auto dijkstra = [&](auto & queue) {
+    std::vector<unsigned> dist(n, unreached);
+    dist[0] = 0;
+    queue.push(0u, 0u);
+    unsigned d, u;
+    while (!queue.empty()) {
+      queue.pop(d, u);
+      if (d != dist[u]) continue;
+      for (auto [v, w] : edges[u]) {
+        if (d + w < dist[v]) {
+          dist[v] = d + w;
+          queue.push(d + w, v);
+        }
+      }
+    }
+    return dist;
+  };
+
+  struct HeapAdapter
+  {
+    PriorityQueue<std::pair<unsigned, unsigned>> heap;
+    bool empty() const { return heap.empty(); }
+    void push(unsigned d, unsigned u) { heap.push({d, u}); }
+    void pop(unsigned & d, unsigned & u)
+    {
+      std::pair<unsigned, unsigned> top;
+      heap.pop(top);
+      d = top.first;
+      u = top.second;
+    }
+  } binary;
+  RadixHeap<unsigned, unsigned> radix;
+  BucketQueue<unsigned, unsigned> buckets(maxWeight);
+
+  std::vector<unsigned> expected = dijkstra(binary);
+  EXPECT_EQ(dijkstra(radix), expected);
+  EXPECT_EQ(dijkstra(buckets), expected);
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "../main.cpp"
+
+template <typename Set>
+static std::vector<int> contentsOf(const Set & set)
+{
+  std::vector<int> values;
+  for (auto it = set.cbegin(); it != set.cend(); ++it) values.push_back(*it);
+  return values;
+}
+
+TEST(ConcurrentSkipListTest, SingleThreadMatchesStdSet)
+{
+  ConcurrentSkipList<int> list;
+  std::set<int> reference;
+  EXPECT_TRUE(list.empty());
+  EXPECT_FALSE(list.contains(0));
+  EXPECT_FALSE(list.erase(0));
+  EXPECT_TRUE(list.begin() == list.end());
+
+  std::mt19937 rng(23);
+  for (int i = 0; i < 50000; ++i) {
+    int key = static_cast<int>(rng() % 5000);
+    if (rng() % 3) {
+      EXPECT_EQ(list.insert(key), reference.insert(key).second);
+    } else {
+      EXPECT_EQ(list.erase(key), reference.erase(key) == 1);
+    }
+  }
+  EXPECT_EQ(list.getSize(), reference.size());
+  EXPECT_EQ(contentsOf(list), std::vector<int>(reference.begin(), reference.end()));
+  for (int key = -1; key <= 5000; ++key) {
+    ASSERT_EQ(list.contains(key), reference.count(key) == 1);
+    auto expected = reference.lower_bound(key);
+    auto found = list.lower_bound(key);
+    if (expected == reference.end())
+      EXPECT_TRUE(found == list.end());
+    else
+      EXPECT_EQ(*found, *expected);
+  }
+}
+
+TEST(ConcurrentSkipListTest, CustomComparatorAndNonTrivialValues)
+{
+  ConcurrentSkipList<std::string, std::greater<std::string>> list;
+  for (const char * s : {"kiwi", "apple", "pear", "fig"}) EXPECT_TRUE(list.emplace(s));
+  EXPECT_FALSE(list.insert("fig"));
+  EXPECT_TRUE(list.search("pear"));
+  list.deleteNode("pear");
+  EXPECT_FALSE(list.search("pear"));
+
+  std::vector<std::string> values;
+  for (const std::string & s : list) values.push_back(s);
+  EXPECT_EQ(values, (std::vector<std::string>{"kiwi", "fig", "apple"}));
+  EXPECT_EQ(*list.lower_bound("banana"), "apple");
+}
+
+TEST(ConcurrentSkipListTest, ConcurrentInsertsAndErases)
+{
+  // Thread t owns the keys equal to t modulo the thread count, so the final contents are
+  // known: each thread inserts all of its keys and erases every third one again. All
+  // threads also race on a shared range of keys, which must come out consistent.
+  const int threads = 8;
+  const int per_thread = 20000;
+  const int shared = 500;
+  ConcurrentSkipList<int> list;
+  std::atomic<int> sharedInserted(0);
+  std::atomic<int> sharedErased(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      for (int i = 0; i < per_thread; ++i) {
+        int key = i * threads + t;
+        EXPECT_TRUE(list.insert(key));
+        if (i % 3 == 0) {
+          EXPECT_TRUE(list.erase(key));
+        }
+        int contested = -1 - static_cast<int>(rng() % shared);
+        if (rng() % 2) {
+          if (list.insert(contested)) ++sharedInserted;
+        } else {
+          if (list.erase(contested)) ++sharedErased;
+        }
+      }
+    });
+  }
+  for (auto & worker : workers) worker.join();
+
+  std::vector<int> values = contentsOf(list);
+  EXPECT_TRUE(std::is_sorted(values.begin(), values.end()));
+  EXPECT_TRUE(std::adjacent_find(values.begin(), values.end()) == values.end());
+  size_t contestedLeft = std::count_if(values.begin(), values.end(), [](int v) { return v < 0; });
+  EXPECT_EQ(contestedLeft, static_cast<size_t>(sharedInserted - sharedErased));
+
+  size_t owned = 0;
+  for (int key = 0; key < threads * per_thread; ++key) {
+    bool expected = (key / threads) % 3 != 0;
+    ASSERT_EQ(list.contains(key), expected) << key;
+    owned += expected;
+  }
+  EXPECT_EQ(list.getSize(), owned + contestedLeft);
+}
+
+TEST(ConcurrentSkipListTest, ReadersSeeStableKeysWhileWritersChurn)
+{
+  // Even keys stay in the set throughout; writers keep inserting and erasing odd keys.
+  // Readers must always find the even keys and iterate in order.
+  const int range = 4000;
+  ConcurrentSkipList<int> list;
+  for (int key = 0; key < range; key += 2) list.insert(key);
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; ++t) {
+    writers.emplace_back([&, t] {
+      std::mt19937 rng(100 + t);
+      for (int i = 0; i < 100000; ++i) {
+        int key = 2 * static_cast<int>(rng() % (range / 2)) + 1;
+        if (rng() % 2)
+          list.insert(key);
+        else
+          list.erase(key);
+      }
+    });
+  }
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 2; ++t) {
+    readers.emplace_back([&, t] {
+      std::mt19937 rng(200 + t);
+      while (!done) {
+        int key = 2 * static_cast<int>(rng() % (range / 2));
+        ASSERT_TRUE(list.contains(key));
+        auto it = list.lower_bound(key - 1);
+        ASSERT_TRUE(it != list.end());
+        ASSERT_LE(*it, key);
+        int previous = -1;
+        int evens = 0;
+        for (int v : list) {
+          ASSERT_LT(previous, v);
+          previous = v;
+          evens += v % 2 == 0;
+        }
+        ASSERT_EQ(evens, range / 2);
+      }
+    });
+  }
+  for (auto & writer : writers) writer.join();
+  done = true;
+  for (auto & reader : readers) reader.join();
+}